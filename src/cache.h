@@ -16,14 +16,29 @@
     #define EARLY_CLEAR
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define WATER_SIMD_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define WATER_SIMD_NEON
+#endif
+
 struct ShaderCache {
     enum Effect { FX_NONE = 0, FX_UNDERWATER = 1, FX_ALPHA_TEST = 2 };
 
     Shader *shaders[Core::passMAX][Shader::MAX][(FX_UNDERWATER | FX_ALPHA_TEST) + 1];
     PSO    *pso[Core::passMAX][Shader::MAX][(FX_UNDERWATER | FX_ALPHA_TEST) + 1][bmMAX];
 
+#ifdef USE_ATLAS_PALETTE
+    bool   palette; // compiled for the indexed atlases
+#endif
+
     ShaderCache() {
         memset(shaders, 0, sizeof(shaders));
+    #ifdef USE_ATLAS_PALETTE
+        palette = Core::paletteTex != NULL;
+    #endif
 
         LOG("shader: cache warm-up...\n");
         prepareCompose(FX_NONE);
@@ -154,6 +169,10 @@ struct ShaderCache {
 
                 if (fx & FX_UNDERWATER) SD_ADD(UNDERWATER);
                 if (fx & FX_ALPHA_TEST) SD_ADD(ALPHA_TEST);
+            #ifdef USE_ATLAS_PALETTE
+                if (palette && type != Shader::MIRROR)
+                    SD_ADD(OPT_PALETTE);
+            #endif
 
                 if (pass == Core::passCompose) {
                     if (Core::settings.detail.lighting > Core::Settings::MEDIUM && (type == Shader::ENTITY))
@@ -167,7 +186,14 @@ struct ShaderCache {
                 }
                 break;
             }
-            case Core::passSky     : def[defCount++] = SD_SKY_TEXTURE + type;    break;
+            case Core::passSky     : {
+                def[defCount++] = SD_SKY_TEXTURE + type;
+            #ifdef USE_ATLAS_PALETTE
+                if (palette && type != Shader::SKY_AZURE)
+                    SD_ADD(OPT_PALETTE);
+            #endif
+                break;
+            }
             case Core::passWater   : def[defCount++] = SD_WATER_DROP + type;     break;
             case Core::passFilter  : def[defCount++] = SD_FILTER_UPSCALE + type; break;
             case Core::passGUI     : break;
@@ -429,8 +455,15 @@ struct WaterCache {
     #define MAX_INVISIBLE_TIME 5.0f
     #define SIMULATE_TIMESTEP  (1.0f / 40.0f)
     #define WATER_TILE_SIZE    64
-    #define DETAIL             (WATER_TILE_SIZE / 1024.0f)
     #define MAX_DROPS          32
+    #define RIPPLE_TILE_SIZE   16   // cells per sector for the CPU simulation
+    #define RIPPLE_MAX_STEPS   4
+    #define RIPPLE_SHIFT       13   // fixed point height and speed
+    #define WATER_LOD_COUNT    3    // every level halves the grid resolution and the step rate
+    #define WATER_LOD_DELAY    0.5f // seconds a new level must persist before the grid is rebuilt
+    #define WATER_LOD_DIST     6144.0f
+
+    struct Ripple;
 
     IGame     *game;
     TR::Level *level;
@@ -448,13 +481,81 @@ struct WaterCache {
         Texture *mask;
         Texture *caustics;
         Texture *data[2];
+        Ripple  *ripple;
+
+        uint8   *sectors;   // water mask per sector
+        int     width, height;
+        int     lod, lodTarget;
+        float   lodTimer;
+        float   area;       // projected screen area fraction
+        bool    paused;
+
+        struct Cost {
+            int steps, cells;         // current second
+            int lastSteps, lastCells; // previous second
+        } cost;
 
         Item() {
             mask = caustics = data[0] = data[1] = NULL;
+            ripple  = NULL;
+            sectors = NULL;
         }
 
-        Item(int from, int to) : from(from), to(to), caust(to), timer(SIMULATE_TIMESTEP), visible(true), blank(true) {
+        Item(int from, int to) : from(from), to(to), caust(to), timer(SIMULATE_TIMESTEP), visible(true), blank(true), lod(0), lodTarget(0), lodTimer(0.0f), area(1.0f), paused(false) {
             mask = caustics = data[0] = data[1] = NULL;
+            ripple  = NULL;
+            sectors = NULL;
+            memset(&cost, 0, sizeof(cost));
+        }
+
+        int getTileSize() const {
+            return (Core::settings.detail.water == Core::Settings::MEDIUM ? RIPPLE_TILE_SIZE : WATER_TILE_SIZE) >> lod;
+        }
+
+        float getDetail() const {
+            return getTileSize() / 1024.0f;
+        }
+
+        float getTimeStep() const {
+            return SIMULATE_TIMESTEP * (1 << lod);
+        }
+
+        void initData() {
+            if (Core::settings.detail.water == Core::Settings::MEDIUM) {
+                ripple  = new Ripple(width, height, sectors, RIPPLE_TILE_SIZE >> lod);
+                data[0] = new Texture(ripple->width, ripple->height, 1, FMT_RG_HALF, OPT_VERTEX, ripple->pixels);
+                ripple->tex = data[0];
+            } else {
+                int tile = WATER_TILE_SIZE >> lod;
+                int *mf = new int[4 * width * height * SQR(tile)];
+                memset(mf, 0, sizeof(int) * 4 * width * height * SQR(tile));
+                data[0] = new Texture(width * tile, height * tile, 1, FMT_RG_HALF, OPT_TARGET | OPT_VERTEX, mf);
+                data[1] = new Texture(width * tile, height * tile, 1, FMT_RG_HALF, OPT_TARGET | OPT_VERTEX);
+                delete[] mf;
+            }
+        }
+
+        void deinitData() {
+            delete data[0];
+            delete data[1];
+            data[0] = data[1] = NULL;
+
+            if (ripple) {
+                if (ripple->busy)
+                    ripple->orphan = true; // deleted by the job completion
+                else
+                    delete ripple;
+                ripple = NULL;
+            }
+        }
+
+        bool setLOD(int value) {
+            if (ripple && ripple->busy)
+                return false;
+            deinitData();
+            lod = value;
+            initData();
+            return true;
         }
 
         void init(IGame *game) {
@@ -518,16 +619,14 @@ struct WaterCache {
                     m[(x - minX) + w * (z - minZ)] = hasWater ? 0xFF : 0x00; // TODO: flow map
                 }
             mask = new Texture(w, h, 1, FMT_LUMINANCE, OPT_NEAREST, m);
-            delete[] m;
 
             size = vec3(float((maxX - minX) * 512), 1.0f, float((maxZ - minZ) * 512)); // half size
             pos  = vec3(r.info.x + minX * 1024 + size.x, float(posY), r.info.z + minZ * 1024 + size.z);
 
-            int *mf = new int[4 * w * h * SQR(WATER_TILE_SIZE)];
-            memset(mf, 0, sizeof(int) * 4 * w * h * SQR(WATER_TILE_SIZE));
-            data[0] = new Texture(w * WATER_TILE_SIZE, h * WATER_TILE_SIZE, 1, FMT_RG_HALF, OPT_TARGET | OPT_VERTEX, mf);
-            data[1] = new Texture(w * WATER_TILE_SIZE, h * WATER_TILE_SIZE, 1, FMT_RG_HALF, OPT_TARGET | OPT_VERTEX);
-            delete[] mf;
+            sectors = m;
+            width   = w;
+            height  = h;
+            initData();
 
             caustics = Core::settings.detail.water > Core::Settings::MEDIUM ? new Texture(512, 512, 1, FMT_RGBA, OPT_TARGET | OPT_DEPEND) : NULL;
             
@@ -535,15 +634,17 @@ struct WaterCache {
         }
 
         void deinit() {
-            delete data[0];
-            delete data[1];
+            deinitData();
             delete caustics;
             delete mask;
-            mask = caustics = data[0] = data[1] = NULL;
+            delete[] sectors;
+            mask = caustics = NULL;
+            sectors = NULL;
         }
 
     } items[MAX_SURFACES];
     int count, visible;
+    float costTimer;
 
     int dropCount;
     struct Drop {
@@ -554,7 +655,233 @@ struct WaterCache {
         Drop(const vec3 &pos, float radius, float strength) : pos(pos), radius(radius), strength(strength) {}
     } drops[MAX_DROPS];
 
-    WaterCache(IGame *game) : game(game), level(game->getLevel()), screen(NULL), refract(NULL), count(0), dropCount(0) {
+    // CPU height field for Settings::MEDIUM, stepped on the worker thread and uploaded without render targets
+    struct Ripple {
+        int     width, height, stride;
+        int16   *cells;
+        int16   *heights[2], *speed, *mask;  // planes with a one cell border
+        uint16  *pixels;                     // half float texture data
+        int     channels;
+        Texture *tex;
+        int     steps;
+        uint16  seed;
+        bool    busy, orphan;
+
+        int     dropCount, queueCount;
+        Drop    drops[MAX_DROPS], queue[MAX_DROPS];  // in cells
+
+        Ripple(int w, int h, const uint8 *sectors, int tile) : tex(NULL), steps(0), seed(0x1234), busy(false), orphan(false), dropCount(0), queueCount(0) {
+            width  = w * tile;
+            height = h * tile;
+            stride = (width + 2 + 7) & ~7;
+
+            int planeSize = stride * (height + 2);
+            cells = new int16[planeSize * 4];
+            memset(cells, 0, sizeof(int16) * planeSize * 4);
+            heights[0] = cells;
+            heights[1] = cells + planeSize;
+            speed      = cells + planeSize * 2;
+            mask       = cells + planeSize * 3;
+
+            for (int y = 0; y < height; y++)
+                for (int x = 0; x < width; x++)
+                    mask[getIndex(x, y)] = sectors[x / tile + w * (y / tile)] ? -1 : 0;
+
+            channels = 2;
+        #ifdef _GAPI_GL
+            if (!Core::support.texRG)
+                channels = 4;
+        #endif
+            pixels = new uint16[width * height * channels];
+            memset(pixels, 0, sizeof(uint16) * width * height * channels);
+        }
+
+        ~Ripple() {
+            delete[] cells;
+            delete[] pixels;
+        }
+
+        int getIndex(int x, int y) const {
+            return (y + 1) * stride + (x + 1);
+        }
+
+        static inline int16 sat(int x) {
+            return int16(clamp(x, -32768, 32767));
+        }
+
+        static uint16 toHalf(int16 value) {
+            union { float f; uint32 i; } u;
+            u.f = float(value) * (1.0f / (1 << RIPPLE_SHIFT));
+            uint16 sign = uint16((u.i >> 16) & 0x8000);
+            int    e    = int((u.i >> 23) & 0xFF) - 127 + 15;
+            if (e <= 0)
+                return sign;
+            return uint16(sign | (e << 10) | ((u.i & 0x7FFFFF) >> 13));
+        }
+
+        void addDrop(const Drop &drop) {
+            int16 *h = heights[0];
+            float radius = drop.radius;
+            int x0 = max(0, int(drop.pos.x - radius)), x1 = min(width  - 1, int(drop.pos.x + radius));
+            int y0 = max(0, int(drop.pos.z - radius)), y1 = min(height - 1, int(drop.pos.z + radius));
+            float strength = -drop.strength * (1 << RIPPLE_SHIFT);
+
+            for (int y = y0; y <= y1; y++)
+                for (int x = x0; x <= x1; x++) {
+                    float d = 1.0f - sqrtf(SQR(x - drop.pos.x) + SQR(y - drop.pos.z)) / radius;
+                    if (d <= 0.0f) continue;
+                    int16 &v = h[getIndex(x, y)];
+                    v = sat(v + int(strength * (0.5f - cosf(d * PI) * 0.5f)));
+                }
+        }
+
+    #if defined(WATER_SIMD_SSE2)
+        static inline __m128 widen(__m128i v, bool high) {
+            __m128i x = high ? _mm_unpackhi_epi16(v, v) : _mm_unpacklo_epi16(v, v);
+            return _mm_cvtepi32_ps(_mm_srai_epi32(x, 16));
+        }
+
+        // floor(x + 0.5) like the scalar path, SSE2 has no floor so the truncation is fixed up for negatives
+        static inline __m128i roundi(__m128 x) {
+            __m128  f = _mm_add_ps(x, _mm_set1_ps(0.5f));
+            __m128i t = _mm_cvttps_epi32(f);
+            return _mm_add_epi32(t, _mm_castps_si128(_mm_cmplt_ps(f, _mm_cvtepi32_ps(t))));
+        }
+    #elif defined(WATER_SIMD_NEON)
+        static inline float32x4_t widen(int16x8_t v, bool high) {
+            return vcvtq_f32_s32(vmovl_s16(high ? vget_high_s16(v) : vget_low_s16(v)));
+        }
+
+        // floor(x + 0.5) like the scalar path, vcvtmq is ARMv8 only so the truncation is fixed up for negatives
+        static inline int32x4_t roundi(float32x4_t x) {
+            float32x4_t f = vaddq_f32(x, vdupq_n_f32(0.5f));
+            int32x4_t   t = vcvtq_s32_f32(f);
+            return vaddq_s32(t, vreinterpretq_s32_u32(vcltq_f32(f, vcvtq_f32_s32(t))));
+        }
+    #endif
+
+        // same integration as the WATER_SIMULATE shader, fixed point rows are widened to float lanes
+        void stepRow(int y) {
+            int index = getIndex(0, y);
+            const int16 *c = heights[0] + index;
+            const int16 *u = c - stride;
+            const int16 *d = c + stride;
+            const int16 *m = mask + index;
+            int16 *v = speed + index;
+            int16 *o = heights[1] + index;
+
+            const float vel   = 1.4f;
+            const float vis   = 0.995f;
+            const float noise = 0.00025f * (1 << RIPPLE_SHIFT) / 32768.0f;
+
+            int x = 0;
+        #if defined(WATER_SIMD_SSE2)
+            __m128i rnd = _mm_set_epi16(seed * 7 + y, seed * 5 + y, seed * 3 + y, seed + y, seed ^ 0x5555, y * 13, seed + 11, y * 31);
+            for (; x + 8 <= width; x += 8) {
+                __m128i h  = _mm_loadu_si128((__m128i*)(c + x));
+                __m128i s  = _mm_loadu_si128((__m128i*)(v + x));
+                __m128i hl = _mm_loadu_si128((__m128i*)(c + x - 1));
+                __m128i hr = _mm_loadu_si128((__m128i*)(c + x + 1));
+                __m128i hu = _mm_loadu_si128((__m128i*)(u + x));
+                __m128i hd = _mm_loadu_si128((__m128i*)(d + x));
+                rnd = _mm_add_epi16(_mm_mullo_epi16(rnd, _mm_set1_epi16(25173)), _mm_set1_epi16(13849));
+
+                __m128i rh[2], rs[2];
+                for (int k = 0; k < 2; k++) {
+                    __m128 fh = widen(h, k != 0);
+                    __m128 avg = _mm_mul_ps(_mm_add_ps(_mm_add_ps(widen(hl, k != 0), widen(hr, k != 0)), _mm_add_ps(widen(hu, k != 0), widen(hd, k != 0))), _mm_set1_ps(0.25f));
+                    __m128 fs = _mm_add_ps(widen(s, k != 0), _mm_mul_ps(_mm_sub_ps(avg, fh), _mm_set1_ps(vel)));
+                    fs = _mm_mul_ps(fs, _mm_set1_ps(vis));
+                    fh = _mm_add_ps(fh, _mm_add_ps(fs, _mm_mul_ps(widen(rnd, k != 0), _mm_set1_ps(noise))));
+                    rh[k] = roundi(fh);
+                    rs[k] = roundi(fs);
+                }
+
+                __m128i k = _mm_loadu_si128((__m128i*)(m + x));
+                _mm_storeu_si128((__m128i*)(v + x), _mm_and_si128(_mm_packs_epi32(rs[0], rs[1]), k));
+                _mm_storeu_si128((__m128i*)(o + x), _mm_and_si128(_mm_packs_epi32(rh[0], rh[1]), k));
+            }
+        #elif defined(WATER_SIMD_NEON)
+            uint16x8_t rnd = { uint16(seed + y), uint16(seed * 3 + y), uint16(seed * 5 + y), uint16(seed * 7 + y), uint16(seed ^ 0x5555), uint16(y * 13), uint16(seed + 11), uint16(y * 31) };
+            for (; x + 8 <= width; x += 8) {
+                int16x8_t h  = vld1q_s16(c + x);
+                int16x8_t s  = vld1q_s16(v + x);
+                int16x8_t hl = vld1q_s16(c + x - 1);
+                int16x8_t hr = vld1q_s16(c + x + 1);
+                int16x8_t hu = vld1q_s16(u + x);
+                int16x8_t hd = vld1q_s16(d + x);
+                rnd = vmlaq_n_u16(vdupq_n_u16(13849), rnd, 25173);
+                int16x8_t n = vreinterpretq_s16_u16(rnd);
+
+                int32x4_t rh[2], rs[2];
+                for (int k = 0; k < 2; k++) {
+                    float32x4_t fh  = widen(h, k != 0);
+                    float32x4_t avg = vmulq_n_f32(vaddq_f32(vaddq_f32(widen(hl, k != 0), widen(hr, k != 0)), vaddq_f32(widen(hu, k != 0), widen(hd, k != 0))), 0.25f);
+                    float32x4_t fs  = vmlaq_n_f32(widen(s, k != 0), vsubq_f32(avg, fh), vel);
+                    fs = vmulq_n_f32(fs, vis);
+                    fh = vaddq_f32(fh, vmlaq_n_f32(fs, widen(n, k != 0), noise));
+                    rh[k] = roundi(fh);
+                    rs[k] = roundi(fs);
+                }
+
+                int16x8_t k = vld1q_s16(m + x);
+                vst1q_s16(v + x, vandq_s16(vcombine_s16(vqmovn_s32(rs[0]), vqmovn_s32(rs[1])), k));
+                vst1q_s16(o + x, vandq_s16(vcombine_s16(vqmovn_s32(rh[0]), vqmovn_s32(rh[1])), k));
+            }
+        #endif
+            uint16 r = seed + y;
+            for (; x < width; x++) {
+                r = uint16(r * 25173 + 13849);
+
+                float h   = c[x];
+                float avg = (c[x - 1] + c[x + 1] + u[x] + d[x]) * 0.25f;
+                float s   = (v[x] + (avg - h) * vel) * vis;
+                h += s + int16(r) * noise;
+
+                v[x] = sat(int(floorf(s + 0.5f))) & m[x];
+                o[x] = sat(int(floorf(h + 0.5f))) & m[x];
+            }
+        }
+
+        void process() {
+            for (int i = 0; i < dropCount; i++)
+                addDrop(drops[i]);
+            dropCount = 0;
+
+            for (int i = 0; i < steps; i++) {
+                seed = uint16(seed * 31421 + 6927);
+                for (int y = 0; y < height; y++)
+                    stepRow(y);
+                swap(heights[0], heights[1]);
+            }
+
+            uint16 *ptr = pixels;
+            for (int y = 0; y < height; y++) {
+                int index = getIndex(0, y);
+                for (int x = 0; x < width; x++) {
+                    ptr[0] = toHalf(heights[0][index + x]);
+                    ptr[1] = toHalf(speed[index + x]);
+                    ptr += channels;
+                }
+            }
+        }
+
+        static void processJob(void *userData) {
+            ((Ripple*)userData)->process();
+        }
+
+        static void completeJob(void *userData) {
+            Ripple *ripple = (Ripple*)userData;
+            ripple->busy = false;
+            if (ripple->orphan) {
+                delete ripple;
+                return;
+            }
+            ripple->tex->update(ripple->pixels);
+        }
+    };
+
+    WaterCache(IGame *game) : game(game), level(game->getLevel()), screen(NULL), refract(NULL), count(0), costTimer(0.0f), dropCount(0) {
         reflect = new Texture(512, 512, 1, FMT_RGBA, OPT_TARGET);
     }
 
@@ -567,6 +894,13 @@ struct WaterCache {
     }
 
     void update() {
+        bool flush = false;
+        costTimer += Core::deltaTime;
+        if (costTimer >= 1.0f) {
+            costTimer -= 1.0f;
+            flush = true;
+        }
+
         int i = 0;
         while (i < count) {
             Item &item = items[i];
@@ -576,6 +910,12 @@ struct WaterCache {
                 continue;
             }
             item.timer += Core::deltaTime;
+
+            if (flush) {
+                item.cost.lastSteps = item.cost.steps;
+                item.cost.lastCells = item.cost.cells;
+                item.cost.steps = item.cost.cells = 0;
+            }
             i++;
         }
     }
@@ -668,7 +1008,8 @@ struct WaterCache {
     void drop(Item &item) { 
         if (!dropCount) return;
 
-        vec2 s(item.size.x * DETAIL * 2.0f, item.size.z * DETAIL * 2.0f);
+        float detail = item.getDetail();
+        vec2 s(item.size.x * detail * 2.0f, item.size.z * detail * 2.0f);
 
         game->setShader(Core::passWater, Shader::WATER_DROP);
 
@@ -680,10 +1021,10 @@ struct WaterCache {
             Drop &drop = drops[i];
 
             vec3 p;
-            p.x = (drop.pos.x - (item.pos.x - item.size.x)) * DETAIL;
-            p.z = (drop.pos.z - (item.pos.z - item.size.z)) * DETAIL;
+            p.x = (drop.pos.x - (item.pos.x - item.size.x)) * detail;
+            p.z = (drop.pos.z - (item.pos.z - item.size.z)) * detail;
 
-            Core::active.shader->setParam(uParam, vec4(p.x, p.z, drop.radius * DETAIL, -drop.strength));
+            Core::active.shader->setParam(uParam, vec4(p.x, p.z, drop.radius * detail, -drop.strength));
 
             Core::setTarget(item.data[1], NULL, RT_STORE_COLOR);
             Core::setViewport(0, 0, int(s.x + 0.5f), int(s.y + 0.5f));
@@ -695,17 +1036,49 @@ struct WaterCache {
         }
     }
     
+    void stepCPU(Item &item) {
+        Ripple *ripple = item.ripple;
+
+        float detail = item.getDetail();
+        for (int i = 0; i < dropCount && ripple->queueCount < MAX_DROPS; i++) {
+            Drop &drop = drops[i];
+            vec3 p;
+            p.x = (drop.pos.x - (item.pos.x - item.size.x)) * detail;
+            p.z = (drop.pos.z - (item.pos.z - item.size.z)) * detail;
+            ripple->queue[ripple->queueCount++] = Drop(p, drop.radius * detail, drop.strength);
+        }
+
+        float timeStep = item.getTimeStep();
+        if (ripple->busy || (item.timer < timeStep && !ripple->queueCount))
+            return;
+
+        int steps = int(item.timer / timeStep);
+        item.timer -= steps * timeStep;
+
+        ripple->steps = min(steps, RIPPLE_MAX_STEPS);
+        item.cost.steps += ripple->steps;
+        item.cost.cells += ripple->steps * ripple->width * ripple->height;
+        memcpy(ripple->drops, ripple->queue, ripple->queueCount * sizeof(Drop));
+        ripple->dropCount  = ripple->queueCount;
+        ripple->queueCount = 0;
+        ripple->busy       = true;
+
+        Core::worker.add(Ripple::processJob, Ripple::completeJob, ripple);
+    }
+
     void step(Item &item) {
-        if (item.timer < SIMULATE_TIMESTEP) return;
+        float timeStep = item.getTimeStep();
+        if (item.timer < timeStep) return;
 
-        vec2 s(item.size.x * DETAIL * 2.0f, item.size.z * DETAIL * 2.0f);
+        float detail = item.getDetail();
+        vec2 s(item.size.x * detail * 2.0f, item.size.z * detail * 2.0f);
 
         game->setShader(Core::passWater, Shader::WATER_SIMULATE);
         Core::active.shader->setParam(uParam, vec4(0.995f, 1.0f, randf() * 0.5f, Core::params.x));
         Core::active.shader->setParam(uTexParam, vec4(1.0f / item.data[0]->width, 1.0f / item.data[0]->height, s.x / item.data[0]->width, s.y / item.data[0]->height));
         Core::active.shader->setParam(uRoomSize, vec4(1.0f / item.mask->origWidth, 1.0f / item.mask->origHeight, float(item.mask->origWidth) / item.mask->width, float(item.mask->origHeight) / item.mask->height));
 
-        while (item.timer >= SIMULATE_TIMESTEP) {
+        while (item.timer >= timeStep) {
         // water step
             Core::setTarget(item.data[1], NULL, RT_STORE_COLOR);
             Core::setViewport(0, 0, int(s.x + 0.5f), int(s.y + 0.5f));
@@ -714,7 +1087,9 @@ struct WaterCache {
             game->getMesh()->renderQuad();
             item.data[0]->unbind(sNormal);
             swap(item.data[0], item.data[1]);
-            item.timer -= SIMULATE_TIMESTEP;
+            item.timer -= timeStep;
+            item.cost.steps++;
+            item.cost.cells += int(s.x + 0.5f) * int(s.y + 0.5f);
         }
 
         if (Core::settings.detail.water < Core::Settings::HIGH)
@@ -725,8 +1100,8 @@ struct WaterCache {
         vec4 rPosScale[2] = { vec4(0.0f), vec4(32767.0f / PLANE_DETAIL) };
         Core::active.shader->setParam(uPosScale, rPosScale[0], 2);
 
-        float sx = item.size.x * DETAIL / (item.data[0]->width  / 2);
-        float sz = item.size.z * DETAIL / (item.data[0]->height / 2);
+        float sx = float(item.data[0]->origWidth)  / item.data[0]->width;
+        float sz = float(item.data[0]->origHeight) / item.data[0]->height;
 
         Core::active.shader->setParam(uTexParam, vec4(1.0f / item.data[0]->width, 1.0f / item.data[0]->height, sx, sz));
 
@@ -846,6 +1221,54 @@ struct WaterCache {
         }
     }
 
+    // grid resolution and step rate by projected screen area and distance to the camera
+    void updateLOD(Item &item) {
+        float minX = 1.0f, minY = 1.0f, maxX = -1.0f, maxY = -1.0f;
+        bool behind = false;
+
+        for (int i = 0; i < 4; i++) {
+            vec3 c = item.pos + vec3((i & 1) ? item.size.x : -item.size.x, 0.0f, (i & 2) ? item.size.z : -item.size.z);
+            vec4 p = Core::mViewProj * vec4(c, 1.0f);
+            if (p.w <= 0.0f) {
+                behind = true;
+                break;
+            }
+            p.x /= p.w;
+            p.y /= p.w;
+            minX = min(minX, p.x);
+            minY = min(minY, p.y);
+            maxX = max(maxX, p.x);
+            maxY = max(maxY, p.y);
+        }
+
+        if (behind) { // the camera is above the surface
+            item.area = 1.0f;
+        } else {
+            float w = clamp(maxX, -1.0f, 1.0f) - clamp(minX, -1.0f, 1.0f);
+            float h = clamp(maxY, -1.0f, 1.0f) - clamp(minY, -1.0f, 1.0f);
+            item.area = max(0.0f, w) * max(0.0f, h) * 0.25f;
+        }
+        item.paused = item.area <= 0.0f;
+
+        vec3 d;
+        d.x = max(0.0f, fabsf(Core::viewPos.x - item.pos.x) - item.size.x);
+        d.y = Core::viewPos.y - item.pos.y;
+        d.z = max(0.0f, fabsf(Core::viewPos.z - item.pos.z) - item.size.z);
+
+        int target = item.area > 0.25f ? 0 : (item.area > 0.05f ? 1 : 2);
+        target = max(target, min(int(d.length() / WATER_LOD_DIST), WATER_LOD_COUNT - 1));
+
+        item.lodTarget = target;
+        if (target == item.lod || item.blank) {
+            item.lodTimer = 0.0f;
+            return;
+        }
+
+        item.lodTimer += Core::deltaTime;
+        if (item.lodTimer >= WATER_LOD_DELAY && item.setLOD(target))
+            item.lodTimer = 0.0f;
+    }
+
     void simulate() {
         PROFILE_MARKER("WATER_SIMULATE");
     // simulate water
@@ -855,7 +1278,19 @@ struct WaterCache {
             Item &item = items[i];
             if (!item.visible) continue;
 
-            if (item.timer >= SIMULATE_TIMESTEP || dropCount) {
+            updateLOD(item);
+
+            if (item.paused) { // off screen, keep the surface alive without catching up later
+                item.timer = min(item.timer, item.getTimeStep());
+                continue;
+            }
+
+            if (item.ripple) {
+                stepCPU(item);
+                continue;
+            }
+
+            if (item.timer >= item.getTimeStep() || dropCount) {
                 Core::noiseTex->bind(sDiffuse);
                 item.mask->bind(sMask);
             // add water drops
@@ -947,8 +1382,8 @@ struct WaterCache {
 
             Core::active.shader->setParam(uParam, vec4(float(refract->origWidth) / refract->width, float(refract->origHeight) / refract->height, 0.05f, 0.0f));
 
-            float sx = item.size.x * DETAIL / (item.data[0]->width  / 2);
-            float sz = item.size.z * DETAIL / (item.data[0]->height / 2);
+            float sx = float(item.data[0]->origWidth)  / item.data[0]->width;
+            float sz = float(item.data[0]->origHeight) / item.data[0]->height;
 
             Core::active.shader->setParam(uTexParam, vec4(1.0f / item.data[0]->width, 1.0f / item.data[0]->height, sx, sz));
             Core::active.shader->setParam(uRoomSize, vec4(1.0f / item.mask->origWidth, 1.0f / item.mask->origHeight, float(item.mask->origWidth) / item.mask->width, float(item.mask->origHeight) / item.mask->height));
@@ -1032,7 +1467,12 @@ struct WaterCache {
     #undef MAX_SURFACES
     #undef MAX_INVISIBLE_TIME
     #undef SIMULATE_TIMESTEP
-    #undef DETAIL
+    #undef WATER_LOD_COUNT
+    #undef WATER_LOD_DELAY
+    #undef WATER_LOD_DIST
+    #undef RIPPLE_TILE_SIZE
+    #undef RIPPLE_MAX_STEPS
+    #undef RIPPLE_SHIFT
 };
 
 struct ZoneCache {
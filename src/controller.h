@@ -13,6 +13,122 @@
 
 #define UNLIMITED_AMMO  10000
 
+#define POOL_CHUNK_SIZE (64 * 1024)
+#define POOL_ALIGN      16
+#define POOL_MAX_SIZE   (16 * 1024) // larger blocks go to the heap
+#define POOL_CLASSES    (POOL_MAX_SIZE / POOL_ALIGN + 1)
+
+// level lifetime arena for controllers and their joint arrays
+// freed blocks are kept in per size free lists, so the same controller types reuse the same memory
+struct ControllerPool {
+    struct Header {
+        int   sizeClass;
+        int   size;
+        Header *next;   // free list link
+    };
+
+    struct Chunk {
+        Chunk *next;
+    };
+
+    Chunk  *chunks;
+    uint8  *ptr, *end;
+    Header *freeList[POOL_CLASSES];
+
+    struct Stats {
+        int allocs, reused, frees, live, heap;
+        int used, capacity;
+    } stats;
+
+    ControllerPool() : chunks(NULL), ptr(NULL), end(NULL) {
+        memset(freeList, 0, sizeof(freeList));
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    ~ControllerPool() {
+        release();
+    }
+
+    static int headerSize() {
+        return (sizeof(Header) + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1);
+    }
+
+    void* alloc(size_t size) {
+        int sizeClass = int((size + POOL_ALIGN - 1) / POOL_ALIGN);
+        int blockSize = headerSize() + sizeClass * POOL_ALIGN;
+
+        stats.allocs++;
+        stats.live++;
+
+        Header *h;
+        if (sizeClass >= POOL_CLASSES) {
+            h = (Header*)malloc(blockSize);
+            h->sizeClass = -1;
+            stats.heap++;
+        } else if (freeList[sizeClass]) {
+            h = freeList[sizeClass];
+            freeList[sizeClass] = h->next;
+            stats.reused++;
+        } else {
+            if (ptr + blockSize > end) {
+                int chunkSize = headerSize() + POOL_CHUNK_SIZE;
+                Chunk *chunk = (Chunk*)malloc(chunkSize);
+                chunk->next = chunks;
+                chunks = chunk;
+                ptr = (uint8*)chunk + headerSize();
+                end = (uint8*)chunk + chunkSize;
+                stats.capacity += POOL_CHUNK_SIZE;
+            }
+            h = (Header*)ptr;
+            ptr += blockSize;
+            h->sizeClass = sizeClass;
+        }
+        h->size = int(size);
+        h->next = NULL;
+        stats.used += h->size;
+
+        return (uint8*)h + headerSize();
+    }
+
+    void free(void *p) {
+        if (!p) return;
+        Header *h = (Header*)((uint8*)p - headerSize());
+
+        stats.frees++;
+        stats.live--;
+        stats.used -= h->size;
+
+        if (h->sizeClass == -1) {
+            stats.heap--;
+            ::free(h);
+            return;
+        }
+
+        h->next = freeList[h->sizeClass];
+        freeList[h->sizeClass] = h;
+    }
+
+    template <typename T>
+    T* allocArray(int count) {
+        return (T*)alloc(sizeof(T) * count);
+    }
+
+    // called by the level after all controllers are deleted
+    void release() {
+        ASSERT(stats.live == 0);
+        if (stats.live) return; // something still references the arena
+
+        while (chunks) {
+            Chunk *next = chunks->next;
+            ::free(chunks);
+            chunks = next;
+        }
+        ptr = end = NULL;
+        memset(freeList, 0, sizeof(freeList));
+        memset(&stats, 0, sizeof(stats));
+    }
+} controllerPool;
+
 struct Controller;
 
 struct ICamera {
@@ -104,6 +220,85 @@ struct IGame {
     virtual void stopTrack()                                     {}
 };
 
+// line of sight queries, results are cached per sector pair for a few ticks
+#define LOS_CACHE_SIZE   256
+#define LOS_CACHE_TICKS  3
+#define LOS_BATCH_SIZE   32
+#define LOS_SECTORS      64  // floor info cache for a batch
+
+namespace LOS {
+    enum Mode { MODE_POINT, MODE_LOCATION };
+
+    struct Key {
+        int32 mode, room;
+        int32 from[3], to[3];
+
+        bool operator == (const Key &k) const {
+            return !memcmp(this, &k, sizeof(*this));
+        }
+    };
+
+    struct Entry {
+        Key    key;
+        uint32 tick;
+        bool   valid;
+        bool   visible;
+    };
+
+    // batch query, visible if the ray gets within 512 units of the end point
+    struct Ray {
+        vec3  from, to;
+        int   room;
+        float dist;
+        bool  visible;
+    };
+
+    uint32 tick;
+    Entry  cache[LOS_CACHE_SIZE];
+
+    void reset() {
+        memset(cache, 0, sizeof(cache));
+    }
+
+    void nextTick() {
+        tick++;
+    }
+
+    Key getKey(Mode mode, int room, const vec3 &from, const vec3 &to) {
+        Key key;
+        key.mode    = mode;
+        key.room    = room;
+        key.from[0] = int32(floorf(from.x / 1024.0f));
+        key.from[1] = int32(floorf(from.y / 256.0f));
+        key.from[2] = int32(floorf(from.z / 1024.0f));
+        key.to[0]   = int32(floorf(to.x / 1024.0f));
+        key.to[1]   = int32(floorf(to.y / 256.0f));
+        key.to[2]   = int32(floorf(to.z / 1024.0f));
+        return key;
+    }
+
+    Entry& getEntry(const Key &key) {
+        uint32 hash = fnv32((const char*)&key, sizeof(key));
+        return cache[hash % LOS_CACHE_SIZE];
+    }
+
+    bool get(const Key &key, bool &visible) {
+        Entry &e = getEntry(key);
+        if (!e.valid || tick - e.tick >= LOS_CACHE_TICKS || !(e.key == key))
+            return false;
+        visible = e.visible;
+        return true;
+    }
+
+    void set(const Key &key, bool visible) {
+        Entry &e  = getEntry(key);
+        e.key     = key;
+        e.tick    = tick;
+        e.valid   = true;
+        e.visible = visible;
+    }
+}
+
 struct Controller {
 
     static Controller *first;
@@ -171,7 +366,7 @@ struct Controller {
         flags.state = TR::Entity::asNone;
 
         const TR::Model *m = getModel();
-        joints      = m ? new Basis[m->mCount] : NULL;
+        joints      = m ? controllerPool.allocArray<Basis>(m->mCount) : NULL;
         jointsFrame = -1;
 
         specular   = 0.0f;
@@ -201,20 +396,28 @@ struct Controller {
     }
 
     virtual ~Controller() {
-        delete[] joints;
-        delete[] layers;
-        delete[] explodeParts;
+        controllerPool.free(joints);
+        controllerPool.free(layers);
+        controllerPool.free(explodeParts);
         deactivate(true);
     }
 
+    static void* operator new(size_t size) {
+        return controllerPool.alloc(size);
+    }
+
+    static void operator delete(void *ptr) {
+        controllerPool.free(ptr);
+    }
+
     void updateModel() {
         const TR::Model *model = getModel();
 
         if (!model || model == animation.model)
             return;
         animation.setModel(model);
-        delete[] joints;
-        joints = new Basis[model->mCount];
+        controllerPool.free(joints);
+        joints = controllerPool.allocArray<Basis>(model->mCount);
     }
 
     bool fixRoomIndex() { // TODO: remove this and fix braid
@@ -685,7 +888,7 @@ struct Controller {
 
     void initMeshOverrides() {
         if (layers) return;
-        layers = new MeshLayer[MAX_LAYERS];
+        layers = controllerPool.allocArray<MeshLayer>(MAX_LAYERS);
         memset(layers, 0, sizeof(MeshLayer) * MAX_LAYERS);
         layers[0].model = getEntity().modelIndex - 1;
         layers[0].mask  = 0xFFFFFFFF;
@@ -836,7 +1039,7 @@ struct Controller {
         return animation.getBoundingBox(vec3(0, 0, 0), oriented ? getEntity().rotation.value / 0x4000 : 0);
     }
 
-    int getSpheres(Sphere *spheres) {
+    int getSpheres(Sphere *spheres, uint32 mask = 0xFFFFFFFF) {
         const TR::Model *m = getModel();
         ASSERT(m->mCount <= MAX_JOINTS);
 
@@ -846,6 +1049,7 @@ struct Controller {
 
         int count = 0;
         for (int i = 0; i < m->mCount; i++) {
+            if (!(mask & (1 << i))) continue;
             TR::Mesh &aMesh = level->meshes[level->meshOffsets[m->mStart + i]];
             if (aMesh.radius <= 0) continue;
             vec3 center = joints[i] * aMesh.center;
@@ -975,6 +1179,131 @@ struct Controller {
         return pos;
     }
 
+    // same stepping as trace(..., false) for many rays at once, rays in the same sector at the same height share the floor info
+    void traceBatch(LOS::Ray *rays, int count) {
+        ASSERT(count <= LOS_BATCH_SIZE);
+
+        struct Sector {
+            int   room, x, y, z; // y matters for trapdoors, bridges and stacked floors
+            int   roomNext, roomBelow, roomAbove;
+            float floor, ceiling;
+        } sectors[LOS_SECTORS];
+        int sectorsCount = 0;
+
+        struct State {
+            vec3     pos, dir;
+            float    dist;
+            int      room;
+            int      lr, lx, lz;
+            Sector   info;
+            LOS::Key key;
+            bool     active;
+        } states[LOS_BATCH_SIZE];
+
+        int active = 0;
+        for (int i = 0; i < count; i++) {
+            LOS::Ray &ray = rays[i];
+            State &st = states[i];
+
+            st.key    = LOS::getKey(LOS::MODE_POINT, ray.room, ray.from, ray.to);
+            st.active = false;
+            if (LOS::get(st.key, ray.visible))
+                continue;
+
+            st.pos  = ray.from;
+            st.dir  = ray.to - ray.from;
+            st.dist = st.dir.length();
+            st.room = ray.room;
+            st.lr   = st.lx = st.lz = -1;
+
+            if (st.dist > 1.0f) {
+                st.dir    = st.dir * (1.0f / st.dist);
+                st.active = true;
+                active++;
+            } else {
+                ray.visible = ray.dist < 512.0f;
+                LOS::set(st.key, ray.visible);
+            }
+        }
+
+        while (active) {
+            for (int i = 0; i < count; i++) {
+                State &st = states[i];
+                if (!st.active) continue;
+
+                int px = (int)st.pos.x, py = (int)st.pos.y, pz = (int)st.pos.z;
+                int sx = px / 1024 * 1024 + 512,
+                    sz = pz / 1024 * 1024 + 512;
+
+                if (st.lr != st.room || st.lx != sx || st.lz != sz) {
+                    int index = -1;
+                    for (int j = 0; j < sectorsCount; j++)
+                        if (sectors[j].room == st.room && sectors[j].x == sx && sectors[j].y == py && sectors[j].z == sz) {
+                            index = j;
+                            break;
+                        }
+
+                    if (index == -1) {
+                        TR::Level::FloorInfo info;
+                        getFloorInfo(st.room, vec3(float(sx), float(py), float(sz)), info);
+                        int room = st.room;
+                        if (info.roomNext != TR::NO_ROOM) {
+                            room = info.roomNext;
+                            getFloorInfo(room, vec3(float(sx), float(py), float(sz)), info);
+                        }
+
+                        index = sectorsCount < LOS_SECTORS ? sectorsCount++ : (i % LOS_SECTORS);
+                        Sector &s = sectors[index];
+                        s.room      = st.room;
+                        s.x         = sx;
+                        s.y         = py;
+                        s.z         = sz;
+                        s.roomNext  = room;
+                        s.roomBelow = info.roomBelow;
+                        s.roomAbove = info.roomAbove;
+                        s.floor     = info.floor;
+                        s.ceiling   = info.ceiling;
+                    }
+
+                    st.info = sectors[index];
+                    st.room = st.info.roomNext;
+                    st.lr   = st.room;
+                    st.lx   = sx;
+                    st.lz   = sz;
+                }
+
+                bool blocked = false;
+                if (py > st.info.floor) {
+                    if (st.info.roomBelow != TR::NO_ROOM)
+                        st.room = st.info.roomBelow;
+                    else
+                        blocked = true;
+                }
+
+                if (!blocked && py < st.info.ceiling) {
+                    if (st.info.roomAbove != TR::NO_ROOM)
+                        st.room = st.info.roomAbove;
+                    else
+                        blocked = true;
+                }
+
+                if (!blocked) {
+                    float d = min(st.dist, 32.0f);
+                    st.dist -= d;
+                    st.pos = st.pos + st.dir * d;
+                }
+
+                if (blocked || st.dist <= 1.0f) {
+                    LOS::Ray &ray = rays[i];
+                    ray.visible = (st.pos - ray.from).length() > (ray.dist - 512.0f);
+                    LOS::set(st.key, ray.visible);
+                    st.active = false;
+                    active--;
+                }
+            }
+        }
+    }
+
     int traceX(const TR::Location &from, TR::Location &to) {
         vec3 d = to.pos - from.pos;
         if (fabsf(d.x) < EPS) return 1;
@@ -1256,7 +1585,7 @@ struct Controller {
             }
 
         if (!explodeMask) {
-            delete[] explodeParts;
+            controllerPool.free(explodeParts);
             explodeParts = NULL;
         }
     }
@@ -1356,7 +1685,7 @@ struct Controller {
         mask &= layers[0].mask;
         layers[0].mask &= ~mask;
         
-        explodeParts = new ExplodePart[model->mCount];
+        explodeParts = controllerPool.allocArray<ExplodePart>(model->mCount);
         explodeMask  = 0;
        
         updateJoints();
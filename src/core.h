@@ -53,6 +53,8 @@
 
     #define INV_VIBRATION
     #define INV_QUALITY
+
+    #define USE_ATLAS_COMPRESSION
 #elif ANDROID
     #define _OS_ANDROID 1
     #define _GAPI_GL    1
@@ -88,6 +90,8 @@
     #define INV_GAMEPAD_NO_TRIGGER
     #define INV_GAMEPAD_ONLY
     #define INV_STEREO
+
+    #define USE_ATLAS_PALETTE
 #elif __PSC__
     #define _OS_PSC    1
     #define _GAPI_GL   1
@@ -113,6 +117,8 @@
     #define INV_SINGLE_PLAYER
     #define INV_VIBRATION
     #define INV_GAMEPAD_ONLY
+
+    #define USE_ATLAS_PALETTE
 #elif __linux__
     #define _OS_LINUX 1
     #define _GAPI_GL  1
@@ -120,6 +126,8 @@
     #define INV_VIBRATION
     #define INV_QUALITY
     #define INV_STEREO
+
+    #define USE_ATLAS_COMPRESSION
 #elif __APPLE__
     #define _GAPI_GL 1
     #include "TargetConditionals.h"
@@ -222,6 +230,10 @@
     #define USE_INFLATE
 #endif
 
+#if defined(OS_PTHREAD_MT) || defined(_OS_WIN)
+    #define OS_THREADS
+#endif
+
 #ifdef USE_INFLATE
     #include "libs/tinf/tinf.h"
 #endif
@@ -263,6 +275,15 @@ extern void  osMutexFree     (void *obj);
 extern void  osMutexLock     (void *obj);
 extern void  osMutexUnlock   (void *obj);
 
+#ifdef OS_THREADS
+extern void* osThreadCreate  (void (*proc)(void *arg), void *arg);
+extern void  osThreadJoin    (void *obj);
+extern void* osSemaInit      (int count);
+extern void  osSemaFree      (void *obj);
+extern void  osSemaWait      (void *obj);
+extern void  osSemaPost      (void *obj);
+#endif
+
 extern int   osGetTimeMS     ();
 
 extern bool  osJoyReady      (int index);
@@ -332,6 +353,155 @@ namespace Core {
         ~Lock() { mutex.unlock(); }
     };
 
+    // start() returns false on platforms without threads, caller should do the work in place
+    struct Thread {
+        typedef void (Proc)(void *arg);
+
+        void *obj;
+
+        Thread()  : obj(NULL) {}
+        ~Thread() { join(); }
+
+        bool start(Proc *proc, void *arg) {
+            ASSERT(!obj);
+        #ifdef OS_THREADS
+            obj = osThreadCreate(proc, arg);
+        #endif
+            return obj != NULL;
+        }
+
+        void join() {
+        #ifdef OS_THREADS
+            if (obj) osThreadJoin(obj);
+        #endif
+            obj = NULL;
+        }
+    };
+
+    struct Semaphore {
+        void *obj;
+
+    #ifdef OS_THREADS
+        Semaphore(int count = 0) { obj = osSemaInit(count);     }
+        ~Semaphore()             { if (obj) osSemaFree(obj);    }
+        void wait()              { if (obj) osSemaWait(obj);    }
+        void post()              { if (obj) osSemaPost(obj);    }
+    #else
+        Semaphore(int count = 0) : obj(NULL) {}
+        void wait() {}
+        void post() {}
+    #endif
+    };
+
+    // jobs are processed in order on the worker thread, completions are called on the main thread by update()
+    struct Worker {
+        typedef void (Proc)(void *userData);
+
+        struct Job {
+            Proc *process;
+            Proc *complete;
+            void *userData;
+        };
+
+        Thread      thread;
+        Semaphore   pending;
+        Mutex       lock;
+        Array<Job>  queue;
+        Array<Job>  done;
+        bool        isThreaded;
+        bool        isQuit;
+
+        Worker() : isThreaded(false), isQuit(false) {}
+
+        static void threadProc(void *arg) {
+            Worker *worker = (Worker*)arg;
+
+            while (1) {
+                worker->pending.wait();
+
+                Job job;
+                {
+                    OS_LOCK(worker->lock);
+                    if (worker->isQuit) break;
+                    job = worker->queue[0];
+                    worker->queue.remove(0);
+                }
+
+                if (job.process) {
+                    job.process(job.userData);
+                }
+
+                OS_LOCK(worker->lock);
+                worker->done.push(job);
+            }
+        }
+
+        void start() {
+            isQuit     = false;
+            isThreaded = thread.start(threadProc, this);
+        }
+
+        void stop() {
+            if (isThreaded) {
+                {
+                    OS_LOCK(lock);
+                    isQuit = true;
+                }
+                pending.post();
+                thread.join();
+                isThreaded = false;
+            }
+            queue.clear();
+            done.clear();
+        }
+
+        void add(Proc *process, Proc *complete, void *userData) {
+            Job job;
+            job.process  = process;
+            job.complete = complete;
+            job.userData = userData;
+
+            OS_LOCK(lock);
+            queue.push(job);
+            if (isThreaded) {
+                pending.post();
+            }
+        }
+
+        // jobs added by completions are handled on the next call
+        void update() {
+            if (!isThreaded) {
+                while (queue.length) {
+                    Job job = queue[0];
+                    queue.remove(0);
+                    if (job.process) {
+                        job.process(job.userData);
+                    }
+                    done.push(job);
+                }
+            }
+
+            int count;
+            {
+                OS_LOCK(lock);
+                count = done.length;
+            }
+
+            while (count--) {
+                Job job;
+                {
+                    OS_LOCK(lock);
+                    job = done[0];
+                    done.remove(0);
+                }
+
+                if (job.complete) {
+                    job.complete(job.userData);
+                }
+            }
+        }
+    } worker, ioWorker;
+
     float deltaTime;
     int   lastTime;
     int   x, y, width, height;
@@ -352,6 +522,7 @@ namespace Core {
         bool texRG;
         bool texBorder;
         bool texMaxLevel;
+        bool texBC, texETC2;
         bool colorFloat, texFloat, texFloatLinear;
         bool colorHalf, texHalf,  texHalfLinear;
     #ifdef PROFILE
@@ -461,6 +632,18 @@ namespace Core {
     }
 }
 
+bool Stream::isAsync() {
+    return Core::ioWorker.isThreaded;
+}
+
+bool Stream::openAsync() {
+    if (!isAsync())
+        return false;
+    pending.push(this);
+    Core::ioWorker.add(ioProcess, ioComplete, this);
+    return true;
+}
+
 #ifdef VR_SUPPORT
 extern void osToggleVR(bool enable);
 #else
@@ -544,6 +727,10 @@ enum TexFormat {
     FMT_RG_HALF,
     FMT_DEPTH,
     FMT_SHADOW,
+    FMT_BC1,
+    FMT_BC3,
+    FMT_ETC2,
+    FMT_INDEX,
     FMT_MAX,
 };
 
@@ -617,7 +804,8 @@ struct MeshRange {
     E( sNormal          ) \
     E( sReflect         ) \
     E( sShadow          ) \
-    E( sMask            )
+    E( sMask            ) \
+    E( sPalette         )
 
 #define SHADER_UNIFORMS(E) \
     E( uParam           ) \
@@ -671,7 +859,8 @@ struct MeshRange {
     E( OPT_AMBIENT     ) \
     E( OPT_SHADOW      ) \
     E( OPT_CONTACT     ) \
-    E( OPT_CAUSTICS    )
+    E( OPT_CAUSTICS    ) \
+    E( OPT_PALETTE     )
 
 enum AttribType   { SHADER_ATTRIBS(DECL_ENUM)  aMAX };
 enum SamplerType  { SHADER_SAMPLERS(DECL_ENUM) sMAX };
@@ -713,6 +902,9 @@ namespace Core {
     int lightStackCount;
 
     Texture *whiteTex, *whiteCube, *blackTex, *ditherTex, *noiseTex, *perlinTex;
+#ifdef USE_ATLAS_PALETTE
+    Texture *paletteTex; // colours of the indexed level atlases, NULL for RGBA atlases
+#endif
 
     enum Pass { passCompose, passShadow, passAmbient, passSky, passWater, passFilter, passGUI, passMAX } pass;
 
@@ -1090,10 +1282,16 @@ namespace Core {
         memset(&active, 0, sizeof(active));
         renderState = 0;
 
+        worker.start();
+        ioWorker.start();
+
         resetTime();
     }
 
     void deinit() {
+        ioWorker.stop();
+        worker.stop();
+
         delete eyeTex[0];
         delete eyeTex[1];
         delete whiteTex;
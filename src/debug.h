@@ -5,6 +5,8 @@
 #include "format.h"
 #include "controller.h"
 #include "mesh.h"
+#include "cache.h"
+#include "rope.h"
 
 namespace Debug {
 
@@ -728,6 +730,16 @@ namespace Debug {
             }
         }
 
+        void water(WaterCache *cache) {
+            char buf[255];
+            for (int i = 0; i < cache->count; i++) {
+                WaterCache::Item &item = cache->items[i];
+                if (!item.visible || item.blank) continue;
+                sprintf(buf, "lod = %d (%d), area = %.3f, steps = %d, cells = %d%s", item.lod, item.lodTarget, item.area, item.cost.lastSteps, item.cost.lastCells, item.paused ? ", paused" : "");
+                Debug::Draw::text(item.pos, vec4(0.5f, 0.8f, 1.0f, 1.0f), buf);
+            }
+        }
+
         void info(IGame *game, Controller *controller, Animation &anim) {
             TR::Level &level = *game->getLevel();
 
@@ -765,6 +777,17 @@ namespace Debug {
                 (saveStats.secrets & 1) ? '1' : '0', saveStats.pickups, saveStats.mediUsed, saveStats.ammoUsed, saveStats.kills);
             Debug::Draw::text(vec2(16, y += 16), vec4(1.0f), buf);
 
+        #ifdef REWIND
+            sprintf(buf, "rewind: frames = %d, used = %d / %d kb, frame = %d bytes, capture = %.2f ms", saveRewind.count, saveRewind.getUsed() / 1024, REWIND_ARENA_SIZE / 1024, saveRewind.stats.frameSize, saveRewind.stats.timeAvg);
+            Debug::Draw::text(vec2(16, y += 16), vec4(1.0f), buf);
+        #endif
+
+            sprintf(buf, "pool: live = %d, allocs = %d, reused = %d, frees = %d, heap = %d, used = %d / %d kb", controllerPool.stats.live, controllerPool.stats.allocs, controllerPool.stats.reused, controllerPool.stats.frees, controllerPool.stats.heap, controllerPool.stats.used / 1024, controllerPool.stats.capacity / 1024);
+            Debug::Draw::text(vec2(16, y += 16), vec4(1.0f), buf);
+
+            sprintf(buf, "ropes: count = %d, particles = %d, substeps = %d, constraints = %d", ropeSystem.stats.ropes, ropeSystem.stats.particles, ropeSystem.stats.substeps, ropeSystem.stats.constraints);
+            Debug::Draw::text(vec2(16, y += 16), vec4(1.0f), buf);
+
             y += 16;
             if (info.lava)
                 Debug::Draw::text(vec2(16, y += 16), vec4(1.0f, 0.5f, 0.3f, 1.0f), "LAVA");
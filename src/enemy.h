@@ -240,7 +240,13 @@ struct Enemy : Character {
             if (target->stand != STAND_UNDERWATER && target->stand != STAND_ONWATER)
                 to.pos.y -= 768.0f;
 
-            return trace(from, to);
+            LOS::Key key = LOS::getKey(LOS::MODE_LOCATION, from.room, from.pos, to.pos);
+            bool visible;
+            if (!LOS::get(key, visible)) {
+                visible = trace(from, to);
+                LOS::set(key, visible);
+            }
+            return visible;
         }
         return false;
     }
@@ -539,7 +545,14 @@ struct Enemy : Character {
             loc.pos  = pos;
             loc.pos.y -= 1024;
 
-            if (trace(eye, loc))
+            LOS::Key key = LOS::getKey(LOS::MODE_LOCATION, eye.room, eye.pos, loc.pos);
+            bool visible;
+            if (!LOS::get(key, visible)) {
+                visible = trace(eye, loc);
+                LOS::set(key, visible);
+            }
+
+            if (visible)
                 return true;
         }
         return false;
@@ -3248,6 +3248,8 @@ namespace TR {
         }
 
         ~Level() {
+            Stream::cancel(this); // MAIN.SFX
+
         // rooms
             for (int i = 0; i < roomsCount; i++) {
                 Room &r = rooms[i];
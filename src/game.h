@@ -253,7 +253,7 @@ namespace Game {
 
         if (slot > -1) {
             level->loadGame(slot);
-            if (forced) {
+            if (forced && !level->restoreGame(slot)) {
                 level->loadGame(slot);
                 level->loadLevel(saveSlots[slot].getLevelID());
                 level->loadNextLevelData();
@@ -276,6 +276,9 @@ namespace Game {
         if (!Core::update())
             return false;
 
+        Core::ioWorker.update();
+        Core::worker.update();
+
         float delta = Core::deltaTime;
 
         if (nextLevel) {
@@ -312,6 +315,14 @@ namespace Game {
             Input::down[ik9] = false;
         }
 
+    #ifdef REWIND
+        if (Input::down[ik7] && !inventory->isActive()) { // hold to step back through the rewind buffer
+            level->rewindStep(delta);
+            return true;
+        }
+        level->rewindApply(); // restore the world once, on the key release
+    #endif
+
         if (!level->level.isCutsceneLevel())
             delta = min(0.2f, delta);
 
@@ -328,6 +328,7 @@
 // Texture
     #ifdef _OS_WIN
         PFNGLACTIVETEXTUREPROC              glActiveTexture;
+        PFNGLCOMPRESSEDTEXIMAGE2DPROC       glCompressedTexImage2D;
     #endif
 
 // VSync
@@ -806,6 +807,15 @@ namespace GAPI {
 
 
 // Texture
+    #ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+        #define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+        #define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+    #endif
+
+    #ifndef GL_COMPRESSED_RGBA8_ETC2_EAC
+        #define GL_COMPRESSED_RGBA8_ETC2_EAC     0x9278
+    #endif
+
     static const struct FormatDesc {
         GLuint ifmt, fmt;
         GLenum type;
@@ -818,6 +828,10 @@ namespace GAPI {
         { GL_RG16F,           GL_RG,              GL_HALF_FLOAT             }, // RG_HALF
         { GL_DEPTH_COMPONENT, GL_DEPTH_COMPONENT, GL_UNSIGNED_SHORT         }, // DEPTH
         { GL_DEPTH_COMPONENT, GL_DEPTH_COMPONENT, GL_UNSIGNED_SHORT         }, // SHADOW
+        { GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, GL_RGBA, GL_UNSIGNED_BYTE       }, // BC1
+        { GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_RGBA, GL_UNSIGNED_BYTE       }, // BC3
+        { GL_COMPRESSED_RGBA8_ETC2_EAC,     GL_RGBA, GL_UNSIGNED_BYTE       }, // ETC2
+        { GL_LUMINANCE,       GL_LUMINANCE,       GL_UNSIGNED_BYTE          }, // INDEX
     };
 
     struct Texture {
@@ -863,6 +877,26 @@ namespace GAPI {
 
             void *pix = (width == origWidth && height == origHeight && depth == origDepth) ? data : NULL;
 
+            if (isCompressed() || fmt == FMT_INDEX) { // data contains the whole mip chain
+                uint8 *ptr = (uint8*)data;
+                int w = width, h = height;
+                for (int level = 0; ; level++) {
+                    int size;
+                    if (fmt == FMT_INDEX) {
+                        size = w * h;
+                        glTexImage2D(target, level, desc.ifmt, w, h, 0, desc.fmt, desc.type, ptr);
+                    } else {
+                        size = ((w + 3) / 4) * ((h + 3) / 4) * (fmt == FMT_BC1 ? 8 : 16);
+                        glCompressedTexImage2D(target, level, desc.ifmt, w, h, 0, size, ptr);
+                    }
+                    ptr += size;
+                    if (!mipmaps || (w == 1 && h == 1)) break;
+                    w = max(1, w / 2);
+                    h = max(1, h / 2);
+                }
+                return;
+            }
+
             if (isVolume) {
                 glTexImage3D(target, 0, desc.ifmt, width, height, depth, 0, desc.fmt, desc.type, pix);
             } else if (isCube) {
@@ -884,6 +918,10 @@ namespace GAPI {
             }
         }
 
+        bool isCompressed() const {
+            return fmt == FMT_BC1 || fmt == FMT_BC3 || fmt == FMT_ETC2;
+        }
+
         FormatDesc getFormat() {
             FormatDesc desc = formats[fmt];
 
@@ -892,7 +930,7 @@ namespace GAPI {
                 desc.fmt  = GL_RGBA;
             }
 
-            if (fmt == FMT_LUMINANCE && Core::support.texRG) {
+            if ((fmt == FMT_LUMINANCE || fmt == FMT_INDEX) && Core::support.texRG) {
                 desc.ifmt = GL_R8;
                 desc.fmt  = GL_RED;
             }
@@ -932,7 +970,7 @@ namespace GAPI {
 
         void generateMipMap() {
             bind(0);
-            if (glGenerateMipmap) {
+            if (glGenerateMipmap && !isCompressed() && fmt != FMT_INDEX) {
                 glGenerateMipmap(target);
             }
             if ((opt & (OPT_VOLUME | OPT_CUBEMAP | OPT_NEAREST)) == 0 && (Core::support.maxAniso > 0)) {
@@ -950,6 +988,13 @@ namespace GAPI {
             glTexSubImage2D(target, 0, 0, 0, origWidth, origHeight, desc.fmt, desc.type, data);
         }
 
+        void updateRows(const uint8 *data, int y, int count) { // data is a full width * height image
+            ASSERT((opt & (OPT_VOLUME | OPT_CUBEMAP)) == 0);
+            bind(0);
+            FormatDesc desc = getFormat();
+            glTexSubImage2D(target, 0, 0, y, width, count, desc.fmt, desc.type, data + y * width * 4);
+        }
+
         void bind(int sampler) {
             if (opt & OPT_PROXY) return;
             ASSERT(ID);
@@ -987,7 +1032,7 @@ namespace GAPI {
 
             Core::active.textures[0] = NULL;
             bind(0);
-            if (Core::support.maxAniso > 0) {
+            if (Core::support.maxAniso > 0 && fmt != FMT_INDEX) { // indices can't be blended
                 glTexParameteri(target, GL_TEXTURE_MAX_ANISOTROPY_EXT, value > Core::Settings::MEDIUM ? min(int(Core::support.maxAniso), 8) : 1);
             }
             glTexParameteri(target, GL_TEXTURE_MIN_FILTER, filter ? (mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR ) : ( mipmaps ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST ));
@@ -1183,6 +1228,7 @@ namespace GAPI {
         #if defined(_OS_WIN) || defined(_OS_LINUX) || defined(_OS_GCW0) || (defined(__SDL2__) && !defined(_GAPI_GLES)) 
             #ifdef _OS_WIN
                 GetProcOGL(glActiveTexture);
+                GetProcOGL(glCompressedTexImage2D);
             #endif
 
             #ifdef _OS_WIN
@@ -1302,6 +1348,8 @@ namespace GAPI {
         support.texNPOT        = GLES3 || extSupport("_texture_npot") || extSupport("_texture_non_power_of_two");
         support.texRG          = GLES3 || extSupport("_texture_rg");
         support.texMaxLevel    = GLES3 || extSupport("_texture_max_level");
+        support.texBC          = extSupport("_texture_compression_s3tc");
+        support.texETC2        = GLES3 || extSupport("_ES3_compatibility");
 
         #ifdef _GAPI_GLES2 // TODO
             support.shaderBinary = false;
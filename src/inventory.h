@@ -222,6 +222,7 @@ struct Inventory {
 
     IGame   *game;
     Texture *title;
+    Texture::LoadJob *titleJob;
     Texture *background[3]; // [LEFT EYE or SINGLE, RIGHT EYE, TEMP]
     Video   *video;
 
@@ -579,9 +580,25 @@ struct Inventory {
         }
         inv->titleTimer = inv->game->getLevel()->isTitle() ? 0.0f : 3.0f;
 
-        inv->title = Texture::Load(*stream);
-        inv->background[0] = inv->title;
-        delete stream;
+        if (inv->titleJob) {
+            inv->titleJob->cancel();
+        }
+        inv->titleJob = Texture::LoadAsync(stream, titleLoaded, inv);
+    }
+
+    static void titleLoaded(Texture *tex, void *userData) {
+        Inventory *inv = (Inventory*)userData;
+        inv->titleJob = NULL;
+
+        if (inv->background[0] == inv->title) {
+            inv->background[0] = NULL;
+        }
+
+        delete inv->title;
+        inv->title = tex;
+        if (!inv->background[0]) {
+            inv->background[0] = inv->title;
+        }
     }
 
     static void loadVideo(Stream *stream, void *userData) {
@@ -603,12 +620,13 @@ struct Inventory {
         }
     }
 
-    Inventory() : game(NULL), title(NULL), itemsCount(0) {
+    Inventory() : game(NULL), title(NULL), titleJob(NULL), itemsCount(0) {
         memset(background, 0, sizeof(background));
         reset();
     }
 
     ~Inventory() {
+        Stream::cancel(this);
         delete video;
         clear();
     }
@@ -629,6 +647,11 @@ struct Inventory {
 
         delete title;
         title = NULL;
+
+        if (titleJob) {
+            titleJob->cancel();
+            titleJob = NULL;
+        }
     }
 
     void reset() {
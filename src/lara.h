@@ -8,6 +8,7 @@
 #include "sprite.h"
 #include "enemy.h"
 #include "inventory.h"
+#include "rope.h"
 
 // TODO: slide to slide in WALL
 // TODO: static sounds in LEVEL3A
@@ -328,6 +329,20 @@ struct Lara : Character {
     bool        canJump;
 
     int32       networkInput;
+    bool        networkStep;    // remote player is updated by Network at fixed ticks
+    bool        networkReplay;  // re-simulation after a misprediction, no triggers and shots
+
+// enough state to re-run remote player ticks after rollback
+    struct NetState {
+        vec3   pos, angle, velocity, flowVelocity;
+        float  health, oxygen, tilt, angleExt, speed, timer, damageTime, hitTime;
+        int    stand, input, lastInput, roomIndex;
+        int    wpnState, wpnCurrent, wpnNext, armsAnim[2];
+        uint16 flags;
+        bool   dozy, canJump;
+        uint8  animation[sizeof(Animation)];
+        uint8  armsAnimation[2][sizeof(Animation)];
+    };
 
 #ifdef _DEBUG
     //uint16      *dbgBoxes;
@@ -338,36 +353,39 @@ struct Lara : Character {
         vec3 offset;
 
         Basis *basis;
-        struct Joint {
-            vec3 posPrev, pos;
-            float length;
-        } *joints;
         int jointsCount;
-        float time;
+        int rope;
 
-        Braid(Lara *lara, const vec3 &offset) : lara(lara), offset(offset), time(0.0f) {
+        Braid(Lara *lara, const vec3 &offset) : lara(lara), offset(offset) {
             TR::Level *level = lara->level;
             TR::Model *model = getModel();
             jointsCount = model->mCount + 1;
-            joints      = new Joint[jointsCount];
             basis       = new Basis[jointsCount - 1];
 
+            vec3  *pos    = new vec3[jointsCount];
+            float *length = new float[jointsCount];
+
             Basis basis = getBasis();
             basis.translate(offset);
 
             TR::Node *node = (int)model->node < level->nodesDataSize ? (TR::Node*)&level->nodesData[model->node] : NULL;
             for (int i = 0; i < jointsCount - 1; i++) {
                 TR::Node &t = node[min(i, model->mCount - 2)];
-                joints[i].posPrev = joints[i].pos = basis.pos;
-                joints[i].length  = float(t.z);
-                basis.translate(vec3(0.0f, 0.0f, -joints[i].length));
+                pos[i]    = basis.pos;
+                length[i] = float(t.z);
+                basis.translate(vec3(0.0f, 0.0f, -length[i]));
             }
-            joints[jointsCount - 1].posPrev = joints[jointsCount - 1].pos = basis.pos;
-            joints[jointsCount - 1].length  = 1.0f;
+            pos[jointsCount - 1]    = basis.pos;
+            length[jointsCount - 1] = 1.0f;
+
+            rope = ropeSystem.add(jointsCount, pos, length);
+
+            delete[] pos;
+            delete[] length;
         }
 
         ~Braid() {
-            delete[] joints;
+            ropeSystem.remove(rope);
             delete[] basis;
         }
 
@@ -383,101 +401,40 @@ struct Lara : Character {
             return getBasis() * offset;
         }
 
-        void integrate() {
-            float TIMESTEP = Core::deltaTime;
-            float ACCEL    = 16.0f * GRAVITY * 30.0f * TIMESTEP * TIMESTEP;
-            float DAMPING  = 1.5f;
+        // set the anchor and colliders, the chain is stepped by ropeSystem once per tick
+        void update() {
+            if (rope == -1) return;
 
-            if (lara->stand == STAND_UNDERWATER) {
-                ACCEL *= 0.5f;
-                DAMPING = 4.0f;
-            }
+            RopeSystem::Rope &r = ropeSystem.ropes[rope];
+            ropeSystem.setAnchor(rope, getPos());
 
-            DAMPING = 1.0f / (1.0f + DAMPING * TIMESTEP); // Pade approximation
+            r.gravity    = 16.0f * GRAVITY * 30.0f;
+            r.damping    = 1.5f;
+            r.speedLimit = 2048.0f;
 
-            for (int i = 1; i < jointsCount; i++) {
-                Joint &j = joints[i];
-                vec3 delta = j.pos - j.posPrev;
-                delta = delta.normal() * (min(delta.length(), 2048.0f * Core::deltaTime) * DAMPING); // speed limit
-                j.posPrev  = j.pos;
-                j.pos     += delta;
-                if ((lara->stand == STAND_WADE || lara->stand == STAND_ONWATER || lara->stand == STAND_UNDERWATER) && (j.pos.y > lara->waterLevel))
-                    j.pos.y -= ACCEL;
-                else
-                    j.pos.y += ACCEL;
+            if (lara->stand == STAND_UNDERWATER) {
+                r.gravity *= 0.5f;
+                r.damping  = 4.0f;
             }
-        }
 
-        void collide() {
-            TR::Level *level = lara->level;
-            const TR::Model *model = lara->getModel();
+            r.water      = lara->stand == STAND_WADE || lara->stand == STAND_ONWATER || lara->stand == STAND_UNDERWATER;
+            r.waterLevel = lara->waterLevel;
 
             TR::Level::FloorInfo info;
             lara->getFloorInfo(lara->getRoomIndex(), lara->getViewPoint(), info);
+            r.floor = info.floor;
 
-            for (int j = 1; j < jointsCount; j++)
-                if (joints[j].pos.y > info.floor)
-                    joints[j].pos.y = info.floor;
-
-            #define BRAID_RADIUS 0.0f
-
-            lara->updateJoints();
-
-            for (int i = 0; i < model->mCount; i++) {
-                if (!(JOINT_MASK_BRAID & (1 << i))) continue;
-
-                int offset = level->meshOffsets[model->mStart + i];
-                TR::Mesh *mesh = (TR::Mesh*)&level->meshes[offset];
-
-                vec3 center    = lara->joints[i] * mesh->center;
-                float radiusSq = mesh->radius + BRAID_RADIUS;
-                radiusSq *= radiusSq;
-
-                for (int j = 1; j < jointsCount; j++) {
-                    vec3 dir = joints[j].pos - center;
-                    float len = dir.length2() + EPS;
-                    if (len < radiusSq) {
-                        len = sqrtf(len);
-                        dir *= (mesh->radius + BRAID_RADIUS- len) / len;
-                        joints[j].pos += dir * 0.9f;
-                    }
-                }
-            }
-
-            #undef BRAID_RADIUS
-        }
-
-        void solve() {
-            for (int i = 0; i < jointsCount - 1; i++) {
-                Joint &a = joints[i];
-                Joint &b = joints[i + 1];
-
-                vec3 dir = b.pos - a.pos;
-                float len = dir.length() + EPS;
-                dir *= 1.0f / len;
-
-                float d = a.length - len;
-
-                if (i > 0) {
-                    dir *= d * (0.5f * 1.0f);
-                    a.pos -= dir;
-                    b.pos += dir;
-                } else
-                    b.pos += dir * (d * 1.0f);
-            }
+            Sphere spheres[MAX_JOINTS];
+            int count = lara->getSpheres(spheres, JOINT_MASK_BRAID);
+            ropeSystem.setSpheres(rope, spheres, count);
         }
 
-        void update() {
-            joints[0].pos = getPos();
-            integrate(); // Verlet integration step
-            collide();   // check collision with Lara's mesh
-            for (int i = 0; i < jointsCount; i++) // solve connections (springs)
-                solve();
-
+        void updateBasis() {
             vec3 headDir = getBasis().rot * vec3(0.0f, 0.0f, -1.0f);
 
             for (int i = 0; i < jointsCount - 1; i++) {
-                vec3 d = (joints[i + 1].pos - joints[i].pos).normal();
+                vec3 a = ropeSystem.getPos(rope, i);
+                vec3 d = (ropeSystem.getPos(rope, i + 1) - a).normal();
                 vec3 r = d.cross(headDir).normal();
                 vec3 u = d.cross(r).normal();
 
@@ -488,12 +445,14 @@ struct Lara : Character {
                 m.offset() = vec4(0.0f, 0.0f, 0.0f, 1.0f);
 
                 basis[i].identity();
-                basis[i].translate(joints[i].pos);
+                basis[i].translate(a);
                 basis[i].rotate(m.getRot());
             }
         }
         
         void render(MeshBuilder *mesh) {
+            if (rope == -1) return;
+            updateBasis();
             Core::setBasis(basis, jointsCount - 1);
             mesh->renderModel(lara->level->extra.braid);
         }
@@ -507,7 +466,9 @@ struct Lara : Character {
 
         itemHolster  = TR::Entity::NONE;
         hitTimer     = 0.0f;
-        networkInput = -1;
+        networkInput  = -1;
+        networkStep   = false;
+        networkReplay = false;
 
         dozy    = false;
         canJump = true;
@@ -1048,6 +1009,8 @@ struct Lara : Character {
     }
 
     void doShot(bool rightHand, bool leftHand) {
+        if (networkReplay) return;
+
         int *wpnAmmo = game->invCount(wpnCurrent);
 
         if (wpnAmmo && *wpnAmmo != UNLIMITED_AMMO && *wpnAmmo <= 0) { // check for no ammo
@@ -1478,28 +1441,53 @@ struct Lara : Character {
 
         vec3 from = pos - vec3(0, 650, 0);
 
+        LOS::Ray   rays[LOS_BATCH_SIZE];
+        Character *enemies[LOS_BATCH_SIZE];
+        int count = 0;
+
         Controller *c = Controller::first;
-        do {
-            if (!c->getEntity().isEnemy())
-                continue;
+        while (c) {
+            Controller *enemy = c;
+            c = c->next;
+
+            if (enemy->getEntity().isEnemy() && ((Character*)enemy)->isActiveTarget()) {
+                Box box = enemy->getBoundingBox();
+                vec3 p = box.center();
+                p.y = box.min.y + (box.max.y - box.min.y) / 3.0f;
+
+                vec3 v = p - pos;
+                float d = v.length();
+                // target must be in view range -60..+60 degrees
+                if (dir.dot(v.normal()) > 0.5f && d <= TARGET_MAX_DIST) {
+                    LOS::Ray &ray = rays[count];
+                    ray.from = from;
+                    ray.to   = p;
+                    ray.room = getRoomIndex();
+                    ray.dist = d;
+                    enemies[count++] = (Character*)enemy;
+                }
+            }
 
-            Character *enemy = (Character*)c;
-            if (!enemy->isActiveTarget())
-                continue;
+            if (count == LOS_BATCH_SIZE || (!c && count)) {
+                getVisibleTargets(rays, enemies, count, target1, target2, dist);
+                count = 0;
+            }
+        }
 
-            Box box = enemy->getBoundingBox();
-            vec3 p = box.center();
-            p.y = box.min.y + (box.max.y - box.min.y) / 3.0f;
-            
-            vec3 v = p - pos;
-            if (dir.dot(v.normal()) <= 0.5f)
-                continue; // target is out of view range -60..+60 degrees
+        if (!target2 || dist[1] > dist[0] * 4)
+            target2 = target1;
+    }
 
-            float d = v.length();
+    void getVisibleTargets(LOS::Ray *rays, Character **enemies, int count, Controller *&target1, Controller *&target2, float *dist) {
+        traceBatch(rays, count);
 
-            if ((d > dist[0] && d > dist[1]) || !checkOcclusion(from, p, d)) 
+        for (int i = 0; i < count; i++) {
+            if (!rays[i].visible)
                 continue;
 
+            Character *enemy = enemies[i];
+            float d = rays[i].dist;
+
             if (d < dist[0]) {
                 target2 = target1;
                 dist[1] = dist[0];
@@ -1509,16 +1497,17 @@ struct Lara : Character {
                 target2 = enemy;
                 dist[1] = d;
             }
-        } while ((c = c->next));
-
-        if (!target2 || dist[1] > dist[0] * 4)
-            target2 = target1;
+        }
     }
 
     bool checkOcclusion(const vec3 &from, const vec3 &to, float dist) {
-        int room;
-        vec3 d = trace(getRoomIndex(), from, to, room, false); // check occlusion
-        return ((d - from).length() > (dist - 512.0f));
+        LOS::Ray ray;
+        ray.from = from;
+        ray.to   = to;
+        ray.room = getRoomIndex();
+        ray.dist = dist;
+        traceBatch(&ray, 1);
+        return ray.visible;
     }
 
     bool checkHit(Controller *target, const vec3 &from, const vec3 &to, vec3 &point) {
@@ -3016,6 +3005,77 @@ struct Lara : Character {
         dozy = enable;
     }
 
+    static void saveAnimation(uint8 *data, const Animation &anim) {
+        memcpy(data, (const void*)&anim, sizeof(anim));
+    }
+
+    static void loadAnimation(Animation &anim, const uint8 *data) {
+        quat *overrides = anim.overrides;
+        memcpy((void*)&anim, data, sizeof(anim));
+        anim.overrides = overrides;
+    }
+
+    void getNetState(NetState &s) {
+        s.pos          = pos;
+        s.angle        = angle;
+        s.velocity     = velocity;
+        s.flowVelocity = flowVelocity;
+        s.health       = health;
+        s.oxygen       = oxygen;
+        s.tilt         = tilt;
+        s.angleExt     = angleExt;
+        s.speed        = speed;
+        s.timer        = timer;
+        s.damageTime   = damageTime;
+        s.hitTime      = hitTime;
+        s.stand        = stand;
+        s.input        = input;
+        s.lastInput    = lastInput;
+        s.roomIndex    = roomIndex;
+        s.wpnState     = wpnState;
+        s.wpnCurrent   = wpnCurrent;
+        s.wpnNext      = wpnNext;
+        s.flags        = flags.value;
+        s.dozy         = dozy;
+        s.canJump      = canJump;
+        saveAnimation(s.animation, animation);
+        for (int i = 0; i < 2; i++) {
+            s.armsAnim[i] = arms[i].anim;
+            saveAnimation(s.armsAnimation[i], arms[i].animation);
+        }
+    }
+
+    void setNetState(const NetState &s) {
+        pos          = s.pos;
+        angle        = s.angle;
+        velocity     = s.velocity;
+        flowVelocity = s.flowVelocity;
+        health       = s.health;
+        oxygen       = s.oxygen;
+        tilt         = s.tilt;
+        angleExt     = s.angleExt;
+        speed        = s.speed;
+        timer        = s.timer;
+        damageTime   = s.damageTime;
+        hitTime      = s.hitTime;
+        stand        = Stand(s.stand);
+        input        = s.input;
+        lastInput    = s.lastInput;
+        roomIndex    = s.roomIndex;
+        wpnState     = Weapon::State(s.wpnState);
+        wpnCurrent   = TR::Entity::Type(s.wpnCurrent);
+        wpnNext      = TR::Entity::Type(s.wpnNext);
+        flags.value  = s.flags;
+        dozy         = s.dozy;
+        canJump      = s.canJump;
+        loadAnimation(animation, s.animation);
+        for (int i = 0; i < 2; i++) {
+            arms[i].anim = Weapon::Anim::Type(s.armsAnim[i]);
+            loadAnimation(arms[i].animation, s.armsAnimation[i]);
+        }
+        updateZone();
+    }
+
     virtual int getInput() { // TODO: updateInput
         if (level->isCutsceneLevel()) return 0;
 
@@ -3250,6 +3310,9 @@ struct Lara : Character {
     }
 
     virtual void update() {
+        if (networkInput != -1 && !networkStep)
+            return;
+
         if (Input::state[camera->cameraIndex][cLook] && Input::lastState[camera->cameraIndex] == cAction)
             camera->changeView(!camera->firstPerson);
 
@@ -3384,7 +3447,7 @@ struct Lara : Character {
     virtual void updateVelocity() {
         flowVelocity = vec3(0);
 
-        if (!(input & DEATH) && !level->isCutsceneLevel())
+        if (!(input & DEATH) && !level->isCutsceneLevel() && !networkReplay)
             checkTrigger(this, false);
 
     // get turning angle
@@ -24,6 +24,7 @@
 
 #define ANIM_TEX_TIMESTEP (10.0f / 30.0f)
 #define SKY_TIME_PERIOD   (1.0f / 0.005f)
+#define PREFETCH_DELAY    5.0f // seconds of gameplay before the next level files are prefetched
 
 extern void loadLevelAsync(Stream *stream, void *userData);
 
@@ -76,6 +77,17 @@ struct Level : IGame {
     float      cutsceneWaitTimer;
     float      animTexTimer;
     float      statsTimeDelta;
+    float      prefetchTimer;
+
+    uint16     *camerasFlags; // initial camera flags, "once" is set by triggers and not saved
+    TR::Room::Sector *sectorsInit; // initial sectors of all rooms, doors and blocks change them in place
+    uint8      *boxesBlock;   // initial overlap block flags of the boxes
+
+#ifdef REWIND
+    uint8      *rewindData;
+    int32       rewindSteps; // snapshots to drop when the rewind key is released
+    float       rewindTimer;
+#endif
 
     vec3 underwaterColor;
     vec4 underwaterFogParams;
@@ -90,6 +102,10 @@ struct Level : IGame {
         nextLevel = id;
     }
 
+    TR::LevelID getNextLevelID() {
+        return (level.isEnd() || level.isHome()) ? level.getTitleId() : TR::LevelID(level.id + 1);
+    }
+
     virtual void loadNextLevel() {
         if (nextLevel != TR::LVL_MAX) return;
 
@@ -99,7 +115,7 @@ struct Level : IGame {
     //        id = TR::LVL_TR1_TITLE;
     //    else
     //#endif
-        id = (level.isEnd() || level.isHome()) ? level.getTitleId() : TR::LevelID(level.id + 1);
+        id = getNextLevelID();
 
         TR::isGameEnded = level.isEnd();
 
@@ -123,14 +139,21 @@ struct Level : IGame {
         inventory->toggle(playerIndex, Inventory::Page(page));
     }
 
+    int getSaveSize() {
+        // oversized data for save slot
+        return sizeof(SaveStats) + sizeof(int32) + sizeof(SaveItem) * INV_MAX_ITEMS +          // for every save
+               sizeof(SaveState) + sizeof(int32) + sizeof(SaveEntity) * level.entitiesCount;  // only for checkpoints
+    }
+
     SaveSlot createSaveSlot(TR::LevelID id, bool checkpoint, bool dummy = false) {
         SaveSlot slot;
+        slot.data = new uint8[getSaveSize()];
+        slot.size = writeSaveData(slot.data, id, checkpoint, dummy);
+        return slot;
+    }
 
-        // allocate oversized data for save slot
-        slot.data  = new uint8[sizeof(SaveStats) + sizeof(SaveItem) * inventory->itemsCount + // for every save
-                               sizeof(SaveState) + sizeof(SaveEntity) * level.entitiesCount]; // only for checkpoints
-
-        uint8 *ptr = slot.data;
+    int writeSaveData(uint8 *data, TR::LevelID id, bool checkpoint, bool dummy) {
+        uint8 *ptr = data;
 
     // level progress stats
         SaveStats *stats = (SaveStats*)ptr;
@@ -199,9 +222,7 @@ struct Level : IGame {
             }
         }
 
-        slot.size = int32(ptr - slot.data);
-
-        return slot;
+        return int32(ptr - data);
     }
 
     void parseSaveSlot(const SaveSlot &slot) {
@@ -328,6 +349,93 @@ struct Level : IGame {
         loadSlot = slot;
     }
 
+    // reload a checkpoint of the current level without reloading the level data
+    bool restoreGame(int slot) {
+        const SaveSlot &save = saveSlots[slot];
+        if (save.getLevelID() != level.id || !save.isCheckpoint() || level.isTitle() || level.isCutsceneLevel())
+            return false;
+
+        LOG("Restore Game...\n");
+
+        restoreSlot(save);
+        loadSlot = -1;
+        return true;
+    }
+
+    void restoreSlot(const SaveSlot &save) {
+        Network::stop();
+
+        Sound::stopAll();
+        sndWater = sndTrack = NULL;
+
+        if (level.state.flags.flipped)
+            flipMap();
+        updateBlocks(false);
+
+        for (int i = 0; i < level.entitiesCount; i++) {
+            delete (Controller*)level.entities[i].controller;
+            level.entities[i].controller = NULL;
+        }
+        Controller::first = NULL;
+
+        restoreSectors(); // doors record the sectors they block on creation
+
+        for (int i = 0; i < level.camerasCount; i++)
+            level.cameras[i].flags.boxIndex = camerasFlags[i];
+
+        memset(players, 0, sizeof(players));
+        initEntities();
+        player = players[0];
+        camera = player->camera;
+
+        effect = TR::Effect::NONE;
+
+        initSoundSources();
+
+        parseSaveSlot(save);
+
+        Network::start(this);
+
+        Core::resetTime();
+    }
+
+#ifdef REWIND
+    void rewindCapture() {
+        if (level.isTitle() || level.isCutsceneLevel() || ++saveRewind.tick < REWIND_PERIOD)
+            return;
+        saveRewind.tick = 0;
+
+        int time = Core::getTime();
+        saveRewind.push(rewindData, writeSaveData(rewindData, level.id, true, false));
+        saveRewind.addTime(Core::getTime() - time);
+    }
+
+    // step back one retained snapshot per capture period, the world is restored by rewindApply
+    void rewindStep(float delta) {
+        rewindTimer -= delta;
+        if (rewindTimer > 0.0f)
+            return;
+        rewindTimer += REWIND_PERIOD * (1.0f / 30.0f);
+
+        if (saveRewind.count - rewindSteps > 1)
+            rewindSteps++;
+    }
+
+    // shares the checkpoint restore, so the sectors changed by doors and blocks are reset the same way
+    void rewindApply() {
+        rewindTimer = 0.0f;
+        if (!rewindSteps)
+            return;
+        saveRewind.truncate(saveRewind.count - 1 - rewindSteps);
+        rewindSteps = 0;
+
+        SaveSlot slot;
+        slot.data = saveRewind.prev;
+        slot.size = saveRewind.prevSize;
+        restoreSlot(slot);
+    }
+#endif
+
     void clearInventory() {
         int i = inventory->itemsCount;
 
@@ -502,6 +610,7 @@ struct Level : IGame {
         mesh->flipMap();
         level.flipMap();
         updateBlocks(true);
+        LOS::reset();
     }
 
     virtual void setWaterParams(float height) {
@@ -605,6 +714,9 @@ struct Level : IGame {
         Core::whiteTex->bind(sMask);
         Core::whiteTex->bind(sReflect);
         atlasRooms->bind(sDiffuse);
+    #ifdef USE_ATLAS_PALETTE
+        if (Core::paletteTex) Core::paletteTex->bind(sPalette);
+    #endif
 
         if (Core::pass != Core::passShadow) {
             Texture *shadowMap = shadow[player ? player->camera->cameraIndex : 0];
@@ -822,6 +934,9 @@ struct Level : IGame {
     }
 
     virtual Sound::Sample* playSound(int id, const vec3 &pos = vec3(0.0f), int flags = 0) const {
+        if (Network::replaying)
+            return NULL;
+
         if (level.version == TR::VER_TR1_PSX && id == TR::SND_SECRET)
             return NULL;
 
@@ -936,8 +1051,9 @@ struct Level : IGame {
     }
 //==============================
 
-    Level(Stream &stream) : level(stream), waitTrack(false), isEnded(false), cutsceneWaitTimer(0.0f), animTexTimer(0.0f), statsTimeDelta(0.0f) {
+    Level(Stream &stream) : level(stream), waitTrack(false), isEnded(false), cutsceneWaitTimer(0.0f), animTexTimer(0.0f), statsTimeDelta(0.0f), prefetchTimer(0.0f) {
         paused = false;
+        LOS::reset();
 
         level.simpleItems = Core::settings.detail.simple == 1;
         level.initModelIndices();
@@ -967,9 +1083,20 @@ struct Level : IGame {
         }
 
         initTextures();
+    #ifdef USE_ATLAS_PALETTE
+        if (shaderCache->palette != (Core::paletteTex != NULL)) { // atlas format differs from the previous level
+            delete shaderCache;
+            shaderCache = new ShaderCache();
+        }
+    #endif
         mesh = new MeshBuilder(&level, atlasRooms);
+        saveSectors();
         initEntities();
 
+        camerasFlags = new uint16[level.camerasCount];
+        for (int i = 0; i < level.camerasCount; i++)
+            camerasFlags[i] = level.cameras[i].flags.boxIndex;
+
         shadow[0] = shadow[1] = NULL;
         scaleTex     = NULL;
         camera       = NULL;
@@ -996,14 +1123,7 @@ struct Level : IGame {
                 ambientCache->getAmbient(players[0]->getRoomIndex(), players[0]->pos, cube); // add to queue
             }
 
-            for (int i = 0; i < level.soundSourcesCount; i++) {
-                TR::SoundSource &src = level.soundSources[i];
-                int flags = Sound::PAN;
-                if (src.flags & 64)  flags |= Sound::FLIPPED;
-                if (src.flags & 128) flags |= Sound::UNFLIPPED;
-                playSound(src.id, vec3(float(src.x), float(src.y), float(src.z)), flags);
-            }
-
+            initSoundSources();
         }
 
         effect  = TR::Effect::NONE;
@@ -1045,12 +1165,27 @@ struct Level : IGame {
             loadSlot = -1;
         }
 
+    #ifdef REWIND
+        rewindData  = new uint8[getSaveSize()];
+        rewindSteps = 0;
+        rewindTimer = 0.0f;
+        saveRewind.init(getSaveSize());
+    #endif
+
         Network::start(this);
 
         Core::resetTime();
     }
 
     virtual ~Level() {
+        for (int i = 0; i < Stream::pending.length; i++) {
+            Stream *stream = Stream::pending[i];
+            if (stream->callback == playAsync) {
+                delete (TrackRequest*)stream->userData;
+                stream->callback = NULL;
+            }
+        }
+
         UI::init(NULL);
 
         Network::stop();
@@ -1058,6 +1193,17 @@ struct Level : IGame {
         for (int i = 0; i < level.entitiesCount; i++)
             delete (Controller*)level.entities[i].controller;
 
+        controllerPool.release();
+
+        delete[] camerasFlags;
+        delete[] sectorsInit;
+        delete[] boxesBlock;
+
+    #ifdef REWIND
+        delete[] rewindData;
+        saveRewind.reset();
+    #endif
+
         delete shadow[0];
         delete shadow[1];
         delete scaleTex;
@@ -1071,6 +1217,10 @@ struct Level : IGame {
             delete atlasSprites;
             delete atlasGlyphs;
         #endif
+        #ifdef USE_ATLAS_PALETTE
+            delete Core::paletteTex;
+            Core::paletteTex = NULL;
+        #endif
         delete mesh;
 
         Sound::stopAll();
@@ -1080,6 +1230,49 @@ struct Level : IGame {
         inventory->init(playLogo, playVideo);
     }
 
+    void initSoundSources() {
+        for (int i = 0; i < level.soundSourcesCount; i++) {
+            TR::SoundSource &src = level.soundSources[i];
+            int flags = Sound::PAN;
+            if (src.flags & 64)  flags |= Sound::FLIPPED;
+            if (src.flags & 128) flags |= Sound::UNFLIPPED;
+            playSound(src.id, vec3(float(src.x), float(src.y), float(src.z)), flags);
+        }
+    }
+
+    void saveSectors() {
+        int count = 0;
+        for (int i = 0; i < level.roomsCount; i++)
+            count += level.rooms[i].xSectors * level.rooms[i].zSectors;
+
+        sectorsInit = new TR::Room::Sector[count];
+        TR::Room::Sector *s = sectorsInit;
+        for (int i = 0; i < level.roomsCount; i++) {
+            TR::Room &room = level.rooms[i];
+            count = room.xSectors * room.zSectors;
+            memcpy(s, room.sectors, count * sizeof(TR::Room::Sector));
+            s += count;
+        }
+
+        boxesBlock = new uint8[level.boxesCount];
+        for (int i = 0; i < level.boxesCount; i++)
+            boxesBlock[i] = level.boxes[i].overlap.block;
+    }
+
+    // the map must be in the unflipped state, as it was on the level load
+    void restoreSectors() {
+        TR::Room::Sector *s = sectorsInit;
+        for (int i = 0; i < level.roomsCount; i++) {
+            TR::Room &room = level.rooms[i];
+            int count = room.xSectors * room.zSectors;
+            memcpy(room.sectors, s, count * sizeof(TR::Room::Sector));
+            s += count;
+        }
+
+        for (int i = 0; i < level.boxesCount; i++)
+            level.boxes[i].overlap.block = boxesBlock[i];
+    }
+
     void initEntities() {
         for (int i = 0; i < level.entitiesBaseCount; i++) {
             TR::Entity &e = level.entities[i];
@@ -1687,9 +1880,35 @@ struct Level : IGame {
         // get result texture
         tileData = new AtlasTile();
         
-        atlasRooms   = rAtlas->pack(OPT_MIPMAPS | OPT_VRAM_3DS);
-        atlasObjects = oAtlas->pack(OPT_MIPMAPS);
-        atlasSprites = sAtlas->pack(OPT_MIPMAPS);
+    #ifdef USE_ATLAS_PALETTE
+        AtlasColor *rData = rAtlas->build();
+        AtlasColor *oData = oAtlas->build();
+        AtlasColor *sData = sAtlas->build();
+
+    // upload 8-bit indices if all three atlases fit into the one palette
+    // indices can only be point sampled, so the filter setting picks the format on the level load
+        AtlasPalette *palette = (Core::settings.detail.filter == Core::Settings::LOW) ? new AtlasPalette() : NULL;
+        if (palette &&
+            palette->add(rData, rAtlas->width * rAtlas->height) &&
+            palette->add(oData, oAtlas->width * oAtlas->height) &&
+            palette->add(sData, sAtlas->width * sAtlas->height)) {
+            palette->finalize();
+            atlasRooms   = rAtlas->upload(rData, OPT_MIPMAPS | OPT_VRAM_3DS, *palette);
+            atlasObjects = oAtlas->upload(oData, OPT_MIPMAPS, *palette);
+            atlasSprites = sAtlas->upload(sData, OPT_MIPMAPS, *palette);
+            Core::paletteTex = new Texture(ATLAS_PALETTE_SIZE, 1, 1, ATLAS_FORMAT, OPT_NEAREST, palette->colors);
+            LOG("palette : %d + %d colors\n", palette->count, palette->extraCount);
+        } else {
+            atlasRooms   = rAtlas->upload(rData, OPT_MIPMAPS | OPT_VRAM_3DS, true);
+            atlasObjects = oAtlas->upload(oData, OPT_MIPMAPS, true);
+            atlasSprites = sAtlas->upload(sData, OPT_MIPMAPS, true);
+        }
+        delete palette;
+    #else
+        atlasRooms   = rAtlas->pack(OPT_MIPMAPS | OPT_VRAM_3DS, true);
+        atlasObjects = oAtlas->pack(OPT_MIPMAPS, true);
+        atlasSprites = sAtlas->pack(OPT_MIPMAPS, true);
+    #endif
         atlasGlyphs  = gAtlas->pack(0);
 
     #ifdef _OS_3DS
@@ -2154,6 +2373,25 @@ struct Level : IGame {
         controller->render(camera->frustum, mesh, type, room.flags.water);
     }
 
+    void prefetchNextLevel() {
+        TR::LevelID id = getNextLevelID();
+
+        Stream::prefetchClear();
+
+        char buf[64];
+        TR::getGameLevelFile(buf, level.version, id);
+        Stream::prefetch(buf);
+
+        if (level.version == TR::VER_TR2_PC || level.version == TR::VER_TR3_PC)
+            Stream::prefetch(TR::getGameSoundsFile(level.version));
+
+        Stream::prefetch(TR::getGameScreen(id));
+
+        uint8 track = TR::LEVEL_INFO[id].track;
+        if (track != TR::NO_TRACK && Stream::isAsync())
+            TR::getGameTrack(level.version, track, Stream::prefetchLoaded, NULL);
+    }
+
     void loadNextLevelData() {
         isEnded = true;
         char buf[64];
@@ -2240,7 +2478,8 @@ struct Level : IGame {
             if (inventory->isActive())
                 return;
 
-            loadLevel(saveSlots[loadSlot].getLevelID());
+            if (!restoreGame(loadSlot))
+                loadLevel(saveSlots[loadSlot].getLevelID());
             return;
         }
 
@@ -2282,14 +2521,26 @@ struct Level : IGame {
                     animTexTimer -= timeStep;
                 }
 
+                if (prefetchTimer >= 0.0f) {
+                    prefetchTimer += Core::deltaTime;
+                    if (prefetchTimer > PREFETCH_DELAY) {
+                        prefetchTimer = -1.0f;
+                        prefetchNextLevel();
+                    }
+                }
+
                 updateEffect();
 
+                LOS::nextTick();
+
                 Controller *c = Controller::first;
                 while (c) {
                     Controller *next = c->next;
                     c->update();
                     c = next;
                 }
+
+                ropeSystem.update(Core::deltaTime);
             } else {
                 if (camera->spectator) {
                     camera->update();
@@ -2301,6 +2552,11 @@ struct Level : IGame {
 
             Controller::clearInactive();
 
+        #ifdef REWIND
+            if (!paused)
+                rewindCapture();
+        #endif
+
         // underwater ambient sound volume control
             if (camera->isUnderwater()) {
                 if (!sndWater && !level.isCutsceneLevel()) {
@@ -3141,6 +3397,8 @@ struct Level : IGame {
         */
 
             Debug::Level::info(this, player, player->animation);
+            if (waterCache)
+                Debug::Level::water(waterCache);
 
 
         Debug::end();
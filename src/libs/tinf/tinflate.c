@@ -49,6 +49,8 @@ typedef struct {
 
    unsigned char *dest;
    unsigned int *destLen;
+   unsigned char *destStart;
+   unsigned char *destEnd; /* NULL - no limit */
 
    TINF_TREE ltree; /* dynamic length/symbol tree */
    TINF_TREE dtree; /* dynamic distance tree */
@@ -309,6 +311,8 @@ static int tinf_inflate_block_data(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
 
       if (sym < 256)
       {
+         if (d->destEnd && d->dest >= d->destEnd) return TINF_DATA_ERROR;
+
          *d->dest++ = sym;
 
       } else {
@@ -326,6 +330,8 @@ static int tinf_inflate_block_data(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
          /* possibly get more bits from distance code */
          offs = tinf_read_bits(d, dist_bits[dist], dist_base[dist]);
 
+         if (d->destEnd && (length > d->destEnd - d->dest || offs > d->dest - d->destStart)) return TINF_DATA_ERROR;
+
          /* copy match */
          for (i = 0; i < length; ++i)
          {
@@ -356,6 +362,8 @@ static int tinf_inflate_uncompressed_block(TINF_DATA *d)
 
    d->source += 4;
 
+   if (d->destEnd && length > (unsigned int)(d->destEnd - d->dest)) return TINF_DATA_ERROR;
+
    /* copy block */
    for (i = length; i; --i) *d->dest++ = *d->source++;
 
@@ -406,6 +414,14 @@ void tinf_init()
 /* inflate stream from source to dest */
 int tinf_uncompress(void *dest, unsigned int *destLen,
                     const void *source, unsigned int sourceLen)
+{
+   return tinf_uncompress_limit(dest, destLen, 0, source, sourceLen);
+}
+
+/* inflate stream from source to dest, fails instead of writing more than destSize bytes (0 - no limit) */
+/* (OpenLara modification) */
+int tinf_uncompress_limit(void *dest, unsigned int *destLen, unsigned int destSize,
+                          const void *source, unsigned int sourceLen)
 {
    TINF_DATA d;
    int bfinal;
@@ -416,6 +432,8 @@ int tinf_uncompress(void *dest, unsigned int *destLen,
 
    d.dest = (unsigned char *)dest;
    d.destLen = destLen;
+   d.destStart = d.dest;
+   d.destEnd = destSize ? d.dest + destSize : 0;
 
    *destLen = 0;
 
@@ -6,20 +6,42 @@
 #include "format.h"
 #include "controller.h"
 #include "ui.h"
+#include "savegame.h"
 
-#define NET_PROTOCOL            1
+#define NET_PROTOCOL            2
 #define NET_PORT                21468
 
 #define NET_PING_TIMEOUT        ( 1000 * 10   )
 #define NET_PING_PERIOD         ( 1000 * 3    )
-#define NET_SYMC_INPUT_PERIOD   ( 1000 / 25   )
-#define NET_SYMC_STATE_PERIOD   ( 1000 / 1000 )
+#define NET_SYMC_STATE_PERIOD   ( 1000 / 20   )
+
+#define NET_SNAPSHOT_HISTORY    8
+#define NET_SNAPSHOT_DATA       1024
+#define NET_SNAPSHOT_MAX_PARTS  4
+#define NET_SNAPSHOT_BLOCK      32      // words per record (one bit each in the record mask)
+#define NET_SEQ_NONE            0xFFFF
+
+#define NET_TICK_RATE           30
+#define NET_TICK                ( 1.0f / NET_TICK_RATE )
+#define NET_INPUT_REDUNDANCY    8       // every input packet repeats the last N ticks
+#define NET_INPUT_DELAY         2       // remote input buffering in ticks
+#define NET_ROLLBACK_TICKS      16      // input and state history, the longest correctable misprediction
+
+// loopback latency/jitter/loss simulator for testing, e.g. -DNET_LAG_SIM=100
+#ifdef NET_LAG_SIM
+    #ifndef NET_LAG_JITTER
+        #define NET_LAG_JITTER      (NET_LAG_SIM / 2)
+    #endif
+    #ifndef NET_LAG_LOSS
+        #define NET_LAG_LOSS        5   // percent
+    #endif
+#endif
 
 namespace Network {
 
     struct Packet {
         enum Type {
-            HELLO, INFO, PING, PONG, JOIN, ACCEPT, REJECT, INPUT, STATE,
+            HELLO, INFO, PING, PONG, JOIN, ACCEPT, REJECT, INPUT, STATE, SNAPSHOT, ACK,
         };
 
         uint16 type;
@@ -60,7 +82,10 @@ namespace Network {
             } reject;
 
             struct {
-                uint16 mask;
+                uint16 tick;
+                uint8  count;
+                uint8  reserved;
+                uint16 mask[NET_INPUT_REDUNDANCY];
             } input;
 
             struct {
@@ -72,6 +97,21 @@ namespace Network {
                 uint8  stand;
                 uint16 animIndex;
             } state;
+
+            struct {
+                uint16 seq;
+                uint16 base;
+                uint8  part;
+                uint8  parts;
+                uint16 size;
+                uint8  level;
+                uint8  reserved;
+                uint8  data[NET_SNAPSHOT_DATA];
+            } snapshot;
+
+            struct {
+                uint16 seq;
+            } ack;
         };
 
         int getSize() const {
@@ -85,8 +125,13 @@ namespace Network {
                 sizeof(reject),
                 sizeof(input),
                 sizeof(state),
+                sizeof(snapshot) - sizeof(snapshot.data),
+                sizeof(ack),
             };
 
+            if (type == SNAPSHOT)
+                return 2 + 2 + sizes[type] + min(int(snapshot.size), NET_SNAPSHOT_DATA);
+
             if (type >= 0 && type < COUNT(sizes))
                 return 2 + 2 + sizes[type];
             ASSERT(false);
@@ -96,31 +141,170 @@ namespace Network {
 
     IGame *game;
 
+// level state snapshot: SaveState followed by SaveEntity of every base entity, as 32-bit words
+    struct Snapshot {
+        uint32 *data;
+        uint16 seq;
+        bool   valid;
+    };
+
     struct Player {
         NAPI::Peer peer;
         int        pingTime;
         int        pingIndex;
         Controller *controller;
+    // remote input and the player state before each simulated tick
+        uint16     inputs[NET_ROLLBACK_TICKS];
+        int        inputTick[NET_ROLLBACK_TICKS];
+        uint16     predicted[NET_ROLLBACK_TICKS];
+        int        stateTick[NET_ROLLBACK_TICKS];
+        Lara::NetState states[NET_ROLLBACK_TICKS];
+        int        lastTick;    // newest received remote tick
+        int        simTick;     // next remote tick to simulate
+    // snapshots as they were sent to the player, deltas are encoded against the last acknowledged one
+        Snapshot   history[NET_SNAPSHOT_HISTORY];
+        uint16     ackSeq;
+        int        cursor;
     };
 
     Array<Player> players;
 
-    int syncInputTime;
     int syncStateTime;
 
+    bool isClient;
+    bool replaying;
+
+    float  tickTime;
+    int    localTick;
+    uint16 localInputs[NET_INPUT_REDUNDANCY];
+
+#ifdef NET_LAG_SIM
+    struct DelayedPacket {
+        NAPI::Peer to;
+        int        time;
+        Packet     packet;
+    };
+
+    Array<DelayedPacket> delayed;
+#endif
+
+    int      snapshotWords;
+    int      snapshotBlocks;
+    uint16   snapshotSeq;
+    uint32   *snapshotData;
+// client side
+    Snapshot recvHistory[NET_SNAPSHOT_HISTORY];
+    uint32   *recvData;
+    bool     *recvDirty;
+    uint16   recvSeq;
+    uint16   recvBase;
+    uint32   recvParts;
+    uint16   recvLast;
+
+    const int STATE_WORDS  = sizeof(SaveState) / 4;
+    const int ENTITY_WORDS = sizeof(SaveEntity) / 4;
+
+    bool seqNewer(uint16 a, uint16 b) {
+        return int16(a - b) > 0;
+    }
+
+    uint16 seqNext(uint16 seq) {
+        seq++;
+        return seq == NET_SEQ_NONE ? 0 : seq;
+    }
+
+    void initSnapshots(Snapshot *history) {
+        for (int i = 0; i < NET_SNAPSHOT_HISTORY; i++) {
+            history[i].data  = new uint32[snapshotWords];
+            history[i].seq   = NET_SEQ_NONE;
+            history[i].valid = false;
+        }
+    }
+
+    void freeSnapshots(Snapshot *history) {
+        for (int i = 0; i < NET_SNAPSHOT_HISTORY; i++) {
+            delete[] history[i].data;
+            history[i].data = NULL;
+        }
+    }
+
+    Snapshot* getSnapshot(Snapshot *history, uint16 seq) {
+        if (seq == NET_SEQ_NONE)
+            return NULL;
+        Snapshot &s = history[seq % NET_SNAPSHOT_HISTORY];
+        return (s.valid && s.seq == seq) ? &s : NULL;
+    }
+
     void start(IGame *game) {
         Network::game = game;
         NAPI::listen(NET_PORT);
-        syncInputTime = syncStateTime = Core::getTime();
+        syncStateTime = Core::getTime();
+        tickTime  = 0.0f;
+        localTick = 0;
+        replaying = false;
+        memset(localInputs, 0, sizeof(localInputs));
+
+        TR::Level *level = game->getLevel();
+        snapshotWords  = STATE_WORDS + level->entitiesBaseCount * ENTITY_WORDS;
+        snapshotBlocks = (snapshotWords + NET_SNAPSHOT_BLOCK - 1) / NET_SNAPSHOT_BLOCK;
+        snapshotSeq    = 0;
+        snapshotData   = new uint32[snapshotWords];
+        recvData       = new uint32[snapshotWords];
+        recvDirty      = new bool[level->entitiesBaseCount + 1];
+        recvSeq        = NET_SEQ_NONE;
+        recvLast       = NET_SEQ_NONE;
+        initSnapshots(recvHistory);
+    }
+
+    void freePlayer(Player &player) {
+        freeSnapshots(player.history);
     }
 
     void stop() {
+        for (int i = 0; i < players.length; i++)
+            freePlayer(players[i]);
         players.clear();
+    #ifdef NET_LAG_SIM
+        delayed.clear();
+    #endif
+
+        freeSnapshots(recvHistory);
+        delete[] snapshotData;
+        delete[] recvData;
+        delete[] recvDirty;
+        snapshotData = recvData = NULL;
+        recvDirty = NULL;
     }
 
     bool sendPacket(const NAPI::Peer &to, const Packet &packet) {
+    #ifdef NET_LAG_SIM
+        if (rand() % 100 < NET_LAG_LOSS)
+            return true;
+        DelayedPacket dp;
+        dp.to     = to;
+        dp.time   = Core::getTime() + NET_LAG_SIM + (NET_LAG_JITTER ? rand() % NET_LAG_JITTER : 0);
+        dp.packet = packet;
+        delayed.push(dp);
+        return true;
+    #else
         return NAPI::send(to, &packet, packet.getSize()) > 0;
+    #endif
+    }
+
+#ifdef NET_LAG_SIM
+    void sendDelayed(int time) {
+        int i = 0;
+        while (i < delayed.length) {
+            DelayedPacket &dp = delayed[i];
+            if (time >= dp.time) {
+                NAPI::send(dp.to, &dp.packet, dp.packet.getSize());
+                delayed.remove(i); // keep the order of packets with the same delay
+                continue;
+            }
+            i++;
+        }
     }
+#endif
 
     bool recvPacket(NAPI::Peer &from, Packet &packet) {
         int count = NAPI::recv(from, &packet, sizeof(packet));
@@ -158,6 +342,7 @@ namespace Network {
             int delta = time - players[i].pingTime;
 
             if (delta > NET_PING_TIMEOUT) {
+                freePlayer(players[i]);
                 players.removeFast(i);
                 continue;
             }
@@ -172,29 +357,358 @@ namespace Network {
         }
     }
 
-    void syncInput(int time) {
+    void syncInput() {
         Lara *lara = (Lara*)game->getLara();
-        if (!lara) return;
 
-        if ((time - syncInputTime) < NET_SYMC_INPUT_PERIOD)
-            return;
+        localInputs[localTick % NET_INPUT_REDUNDANCY] = lara ? uint16(lara->input) : 0;
 
         Packet packet;
-        packet.type = Packet::INPUT;
-        packet.input.mask = lara->getInput();
+        packet.type           = Packet::INPUT;
+        packet.input.tick     = uint16(localTick);
+        packet.input.count    = min(localTick + 1, NET_INPUT_REDUNDANCY);
+        packet.input.reserved = 0;
+        for (int i = 0; i < packet.input.count; i++)
+            packet.input.mask[i] = localInputs[(localTick - i) % NET_INPUT_REDUNDANCY];
 
         for (int i = 0; i < players.length; i++)
             sendPacket(players[i].peer, packet);
+    }
+
+    uint16 getInput(Player &player, int tick) {
+    // confirmed input or the last known one before it
+        for (int i = tick; i > tick - NET_ROLLBACK_TICKS && i >= 0; i--) {
+            int index = i % NET_ROLLBACK_TICKS;
+            if (player.inputTick[index] == i)
+                return player.inputs[index];
+        }
+        return 0;
+    }
 
-        syncInputTime = time;
+    void simulate(Player &player, int tick) {
+        Lara *lara  = (Lara*)player.controller;
+        int   index = tick % NET_ROLLBACK_TICKS;
+
+        lara->getNetState(player.states[index]);
+        player.stateTick[index] = tick;
+        player.predicted[index] = getInput(player, tick);
+
+        float dt = Core::deltaTime;
+        Core::deltaTime     = NET_TICK;
+        lara->networkInput  = player.predicted[index];
+        lara->networkStep   = true;
+        lara->networkReplay = replaying;
+        lara->update();
+        lara->networkStep   = false;
+        lara->networkReplay = false;
+        Core::deltaTime = dt;
+    }
+
+    void rollback(Player &player, int tick) {
+        int index = tick % NET_ROLLBACK_TICKS;
+        if (player.stateTick[index] != tick)
+            return; // too old to correct
+
+        replaying = true;
+        ((Lara*)player.controller)->setNetState(player.states[index]);
+        for (int i = tick; i < player.simTick; i++)
+            simulate(player, i);
+        replaying = false;
+    }
+
+    void advance(Player &player) {
+        if (player.simTick < 0)
+            return;
+
+        if (player.lastTick - player.simTick >= NET_ROLLBACK_TICKS - NET_INPUT_DELAY)
+            player.simTick = player.lastTick - NET_INPUT_DELAY; // fell too far behind, skip stale input
+
+        int steps = 1;
+        if (player.lastTick - player.simTick > NET_INPUT_DELAY * 2)
+            steps = 2; // remote clock runs ahead, catch up
+        if (player.simTick - player.lastTick >= NET_ROLLBACK_TICKS - 1)
+            steps = 0; // don't predict further than we can roll back
+
+        while (steps--)
+            simulate(player, player.simTick++);
+    }
+
+    void recvInput(Player &player, const Packet &packet) {
+        int tick = (player.lastTick < 0) ? packet.input.tick : player.lastTick + int16(packet.input.tick - uint16(player.lastTick));
+
+        if (player.simTick < 0)
+            player.simTick = max(0, tick - NET_INPUT_DELAY);
+        player.lastTick = max(player.lastTick, tick);
+
+        int rollbackTick = player.simTick;
+
+        for (int i = 0; i < min(int(packet.input.count), NET_INPUT_REDUNDANCY); i++) {
+            int t = tick - i;
+            if (t < 0 || t <= player.simTick - NET_ROLLBACK_TICKS)
+                break;
+
+            int index = t % NET_ROLLBACK_TICKS;
+            if (player.inputTick[index] == t)
+                continue;
+
+            player.inputs[index]    = packet.input.mask[i];
+            player.inputTick[index] = t;
+
+            if (t < player.simTick && player.stateTick[index] == t && player.predicted[index] != packet.input.mask[i])
+                rollbackTick = min(rollbackTick, t);
+        }
+
+        if (rollbackTick < player.simTick)
+            rollback(player, rollbackTick);
+    }
+
+    void updateTick() {
+        syncInput();
+
+        for (int i = 0; i < players.length; i++)
+            advance(players[i]);
+
+        localTick++;
+    }
+
+    void writeSnapshot(uint32 *data) {
+        TR::Level *level = game->getLevel();
+
+        memset(data, 0, snapshotWords * 4);
+        memcpy(data, &level->state, sizeof(level->state));
+
+        SaveEntity *entities = (SaveEntity*)(data + STATE_WORDS);
+        for (int i = 0; i < level->entitiesBaseCount; i++) {
+            Controller *controller = (Controller*)level->entities[i].controller;
+        // players are synced by input
+            if (!controller || controller->getEntity().isLara())
+                continue;
+
+            SaveEntity entity;
+            memset(&entity, 0, sizeof(entity));
+            if (controller->getSaveData(entity))
+                entities[i] = entity;
+        }
+    }
+
+    // returns the number of parts written to packets, changes that don't fit are left for the next snapshot
+    int encodeSnapshot(Player &player, Packet *packets) {
+        Snapshot *base = getSnapshot(player.history, player.ackSeq);
+        Snapshot &sent = player.history[snapshotSeq % NET_SNAPSHOT_HISTORY];
+
+        if (!base)
+            memset(sent.data, 0, snapshotWords * 4);
+        else if (base != &sent)
+            memcpy(sent.data, base->data, snapshotWords * 4);
+
+        int parts = 0;
+        Packet *packet = NULL;
+
+        for (int i = 0; i < snapshotBlocks; i++) {
+            int block = (player.cursor + i) % snapshotBlocks;
+            int start = block * NET_SNAPSHOT_BLOCK;
+            int count = min(NET_SNAPSHOT_BLOCK, snapshotWords - start);
+
+            uint32 *src = snapshotData + start;
+            uint32 *dst = sent.data + start;
+
+            uint32 mask = 0;
+            int changed = 0;
+            for (int j = 0; j < count; j++)
+                if (src[j] != dst[j]) {
+                    mask |= 1u << j;
+                    changed++;
+                }
+
+            if (!mask) continue;
+
+            int size = 2 + 4 + changed * 4;
+
+            if (!packet || packet->snapshot.size + size > NET_SNAPSHOT_DATA) {
+                if (parts == NET_SNAPSHOT_MAX_PARTS) {
+                    player.cursor = block;
+                    break;
+                }
+                packet = &packets[parts++];
+                packet->type            = Packet::SNAPSHOT;
+                packet->snapshot.seq    = snapshotSeq;
+                packet->snapshot.base   = base ? base->seq : NET_SEQ_NONE;
+                packet->snapshot.size   = 0;
+                packet->snapshot.level  = game->getLevel()->id;
+                packet->snapshot.reserved = 0;
+            }
+
+            uint8 *ptr = packet->snapshot.data + packet->snapshot.size;
+            uint16 index = block;
+            memcpy(ptr, &index, 2); ptr += 2;
+            memcpy(ptr, &mask, 4);  ptr += 4;
+            for (int j = 0; j < count; j++)
+                if (mask & (1u << j)) {
+                    memcpy(ptr, src + j, 4);
+                    ptr += 4;
+                    dst[j] = src[j];
+                }
+            packet->snapshot.size += size;
+        }
+
+        if (parts) {
+            sent.seq   = snapshotSeq;
+            sent.valid = true;
+        } else if (base != &sent)
+            sent.valid = false;
+
+        for (int i = 0; i < parts; i++) {
+            packets[i].snapshot.part  = i;
+            packets[i].snapshot.parts = parts;
+        }
+
+        return parts;
     }
 
     void syncState(int time) {
         if ((time - syncStateTime) < NET_SYMC_STATE_PERIOD)
             return;
-        // TODO    
         syncStateTime = time;
-    } 
+
+        if (isClient || !players.length || game->getLevel()->isTitle())
+            return;
+
+        writeSnapshot(snapshotData);
+
+        Packet packets[NET_SNAPSHOT_MAX_PARTS];
+
+        for (int i = 0; i < players.length; i++) {
+            int parts = encodeSnapshot(players[i], packets);
+            for (int j = 0; j < parts; j++)
+                sendPacket(players[i].peer, packets[j]);
+        }
+
+        snapshotSeq = seqNext(snapshotSeq);
+    }
+
+    void applyEntity(Controller *controller, const SaveEntity &data) {
+        controller->setSaveData(data);
+
+        if (controller->flags.state == TR::Entity::asNone)
+            return;
+
+        Controller *c = Controller::first;
+        while (c && c != controller)
+            c = c->next;
+
+        if (!c) {
+            controller->next = Controller::first;
+            Controller::first = controller;
+        }
+    }
+
+    void applySnapshot() {
+        TR::Level *level = game->getLevel();
+
+        if (recvDirty[0]) {
+            SaveState state;
+            memcpy(&state, recvData, sizeof(state));
+            state.flags.track = level->state.flags.track;
+            if (state.flags.flipped != level->state.flags.flipped)
+                game->flipMap();
+            level->state = state;
+        }
+
+        SaveEntity *entities = (SaveEntity*)(recvData + STATE_WORDS);
+        for (int i = 0; i < level->entitiesBaseCount; i++) {
+            if (!recvDirty[i + 1]) continue;
+
+            Controller *controller = (Controller*)level->entities[i].controller;
+            if (!controller || controller->getEntity().isLara())
+                continue;
+
+            applyEntity(controller, entities[i]);
+        }
+    }
+
+    void recvSnapshot(const NAPI::Peer &from, const Packet &packet) {
+        if (!isClient || packet.snapshot.level != game->getLevel()->id)
+            return;
+
+        uint16 seq = packet.snapshot.seq;
+
+        if (recvLast != NET_SEQ_NONE && !seqNewer(seq, recvLast))
+            return;
+
+        if (seq != recvSeq) {
+            if (recvSeq != NET_SEQ_NONE && seqNewer(recvSeq, seq))
+                return; // late part of an outdated snapshot
+
+            if (packet.snapshot.part >= packet.snapshot.parts || packet.snapshot.parts > NET_SNAPSHOT_MAX_PARTS)
+                return;
+
+            Snapshot *base = getSnapshot(recvHistory, packet.snapshot.base);
+            if (packet.snapshot.base != NET_SEQ_NONE && !base)
+                return; // baseline is gone, wait for the host to resend against an acknowledged one
+
+            if (base)
+                memcpy(recvData, base->data, snapshotWords * 4);
+            else
+                memset(recvData, 0, snapshotWords * 4);
+
+            memset(recvDirty, 0, game->getLevel()->entitiesBaseCount + 1);
+            recvSeq   = seq;
+            recvBase  = packet.snapshot.base;
+            recvParts = 0;
+        }
+
+        if (packet.snapshot.base != recvBase || packet.snapshot.part >= NET_SNAPSHOT_MAX_PARTS || (recvParts & (1 << packet.snapshot.part)))
+            return;
+        recvParts |= 1 << packet.snapshot.part;
+
+        const uint8 *ptr = packet.snapshot.data;
+        const uint8 *end = ptr + packet.snapshot.size;
+
+        while (ptr + 6 <= end) {
+            uint16 index;
+            uint32 mask;
+            memcpy(&index, ptr, 2); ptr += 2;
+            memcpy(&mask, ptr, 4);  ptr += 4;
+
+            if (index >= snapshotBlocks)
+                break;
+
+            int start = index * NET_SNAPSHOT_BLOCK;
+            int count = min(NET_SNAPSHOT_BLOCK, snapshotWords - start);
+
+            for (int j = 0; j < count && ptr + 4 <= end; j++) {
+                if (!(mask & (1u << j))) continue;
+                int word = start + j;
+                memcpy(recvData + word, ptr, 4);
+                ptr += 4;
+                recvDirty[word < STATE_WORDS ? 0 : (1 + (word - STATE_WORDS) / ENTITY_WORDS)] = true;
+            }
+        }
+
+        if (recvParts != (1u << packet.snapshot.parts) - 1)
+            return;
+
+        Snapshot &s = recvHistory[seq % NET_SNAPSHOT_HISTORY];
+        memcpy(s.data, recvData, snapshotWords * 4);
+        s.seq   = seq;
+        s.valid = true;
+
+        recvLast = seq;
+        recvSeq  = NET_SEQ_NONE;
+
+        applySnapshot();
+
+        Packet response;
+        response.type    = Packet::ACK;
+        response.ack.seq = seq;
+        sendPacket(from, response);
+    }
+
+    void recvAck(Player *player, uint16 seq) {
+        if (!player || !getSnapshot(player->history, seq))
+            return;
+        if (player->ackSeq == NET_SEQ_NONE || seqNewer(seq, player->ackSeq))
+            player->ackSeq = seq;
+    }
 
     Player* getPlayerByPeer(const NAPI::Peer &peer) {
         for (int i = 0; i < players.length; i++)
@@ -211,6 +725,28 @@ namespace Network {
         angle     = normalizeAngle(lara->angle.y); // 0..2PI
     }
 
+    Player* addPlayer(const NAPI::Peer &peer, int time, uint8 roomIndex, const vec3 &pos, float angle) {
+        Player newPlayer;
+        newPlayer.peer       = peer;
+        newPlayer.pingIndex  = 0;
+        newPlayer.pingTime   = time;
+        newPlayer.controller = game->addEntity(TR::Entity::LARA, roomIndex, pos, angle);
+        if (!newPlayer.controller)
+            return NULL;
+        newPlayer.ackSeq     = NET_SEQ_NONE;
+        newPlayer.cursor     = 0;
+        newPlayer.lastTick   = -1;
+        newPlayer.simTick    = -1;
+        for (int i = 0; i < NET_ROLLBACK_TICKS; i++)
+            newPlayer.inputTick[i] = newPlayer.stateTick[i] = -1;
+        initSnapshots(newPlayer.history);
+        players.push(newPlayer);
+
+        ((Lara*)newPlayer.controller)->networkInput = 0;
+
+        return &players[players.length - 1];
+    }
+
     void update() {
         int count;
         NAPI::Peer from;
@@ -218,6 +754,10 @@ namespace Network {
 
         int time = Core::getTime();
 
+    #ifdef NET_LAG_SIM
+        sendDelayed(time);
+    #endif
+
         while ( (count = recvPacket(from, packet)) > 0 ) {
             Player *player = getPlayerByPeer(from);
             if (player)
@@ -271,21 +811,14 @@ namespace Network {
 
                         getSpawnPoint(roomIndex, pos, angle);
 
-                        Player newPlayer;
-                        newPlayer.peer       = from;
-                        newPlayer.pingIndex  = 0;
-                        newPlayer.pingTime   = time;
-                        newPlayer.controller = game->addEntity(TR::Entity::LARA, roomIndex, pos, angle);
-                        players.push(newPlayer);
-
-                        ((Lara*)newPlayer.controller)->networkInput = 0;
+                        Player *newPlayer = addPlayer(from, time, roomIndex, pos, angle);
+                        if (!newPlayer) // no free entity slots
+                            break;
 
                         char buf[32];
                         packet.join.nick.get(buf);
                         LOG("Player %s joined\n", buf);
 
-                        ASSERT(newPlayer.controller);
-
                         TR::Room &room = game->getLevel()->rooms[roomIndex];
                         vec3 offset = pos - room.getOffset();
 
@@ -304,6 +837,7 @@ namespace Network {
 
                 case Packet::ACCEPT : {
                     LOG("accept!\n");
+                    isClient = true;
                     game->loadLevel(TR::LevelID(packet.accept.level));
                     inventory->toggle();
                     break;
@@ -323,30 +857,37 @@ namespace Network {
 
                         getSpawnPoint(roomIndex, pos, angle);
 
-                        Player newPlayer;
-                        newPlayer.peer       = from;
-                        newPlayer.pingIndex  = 0;
-                        newPlayer.pingTime   = time;
-                        newPlayer.controller = game->addEntity(TR::Entity::LARA, roomIndex, pos, angle);
-                        players.push(newPlayer);
-
-                        ((Lara*)newPlayer.controller)->networkInput = 0;
-
-                        player = getPlayerByPeer(from);
+                        player = addPlayer(from, time, roomIndex, pos, angle);
                     }
 
                     if (player) {
-                        ((Lara*)player->controller)->networkInput = packet.input.mask;
+                        recvInput(*player, packet);
                     }
                     break;
 
                 case Packet::STATE :
                     break;
+
+                case Packet::SNAPSHOT :
+                    recvSnapshot(from, packet);
+                    break;
+
+                case Packet::ACK :
+                    recvAck(player, packet.ack.seq);
+                    break;
             }
         }
 
         pingPlayers(time);
-        syncInput(time);
+
+        if (!game->getLevel()->isTitle()) {
+            tickTime += Core::deltaTime;
+            while (tickTime >= NET_TICK) {
+                tickTime -= NET_TICK;
+                updateTick();
+            }
+        }
+
         syncState(time);
     }
 }
@@ -35,6 +35,9 @@ struct Camera
     int16 angleY;
 
     AABB  frustumBase;
+    vec3i frustumFar;   // far plane corner relative to the view position
+    vec3i frustumFarDX; // far plane edges along the screen axes
+    vec3i frustumFarDY;
 
     Item* item;
 
@@ -205,55 +208,81 @@ struct Camera
         matrixRotateY(angleY);
         matrixRotateX(angleX);
 
-        static const vec3i v[5] = {
-        // near plane
-            vec3i( 0, 0, 0 ),
-        // far plane
+        static const vec3i v[3] = {
+        // far plane corners
             vec3i( -FRUSTUM_FAR_X, -FRUSTUM_FAR_Y, FRUSTUM_FAR_Z ),
             vec3i(  FRUSTUM_FAR_X, -FRUSTUM_FAR_Y, FRUSTUM_FAR_Z ),
-            vec3i( -FRUSTUM_FAR_X,  FRUSTUM_FAR_Y, FRUSTUM_FAR_Z ),
-            vec3i(  FRUSTUM_FAR_X,  FRUSTUM_FAR_Y, FRUSTUM_FAR_Z )
+            vec3i( -FRUSTUM_FAR_X,  FRUSTUM_FAR_Y, FRUSTUM_FAR_Z )
         };
 
         const Matrix &m = matrixGet();
 
-        frustumBase.minX =  0xFFFFFFF;
-        frustumBase.maxX = -0xFFFFFFF;
-        frustumBase.minY =  0xFFFFFFF;
-        frustumBase.maxY = -0xFFFFFFF;
-        frustumBase.minZ =  0xFFFFFFF;
-        frustumBase.maxZ = -0xFFFFFFF;
+        vec3i p[3];
 
-        for (int32 i = 0; i < 5; i++)
+        for (int32 i = 0; i < 3; i++)
         {
-            int32 x = DP43(m[0], v[i]) >> FIXED_SHIFT;
-            int32 y = DP43(m[1], v[i]) >> FIXED_SHIFT;
-            int32 z = DP43(m[2], v[i]) >> FIXED_SHIFT;
-
-            frustumBase.minX = X_MIN(frustumBase.minX, x);
-            frustumBase.maxX = X_MAX(frustumBase.maxX, x);
-            frustumBase.minY = X_MIN(frustumBase.minY, y);
-            frustumBase.maxY = X_MAX(frustumBase.maxY, y);
-            frustumBase.minZ = X_MIN(frustumBase.minZ, z);
-            frustumBase.maxZ = X_MAX(frustumBase.maxZ, z);
+            p[i].x = DP43(m[0], v[i]) >> FIXED_SHIFT;
+            p[i].y = DP43(m[1], v[i]) >> FIXED_SHIFT;
+            p[i].z = DP43(m[2], v[i]) >> FIXED_SHIFT;
         }
 
-        frustumBase.minX += view.pos.x - 1024;
-        frustumBase.maxX += view.pos.x + 1024;
-        frustumBase.minY += view.pos.y - 1024;
-        frustumBase.maxY += view.pos.y + 1024;
-        frustumBase.minZ += view.pos.z - 1024;
-        frustumBase.maxZ += view.pos.z + 1024;
+        frustumFar   = p[0];
+        frustumFarDX = p[1] - p[0];
+        frustumFarDY = p[2] - p[0];
+
+        getFrustum(Rect( 0, 0, FRAME_WIDTH, FRAME_HEIGHT ), frustumBase);
+    }
+
+    // world space bounds of the frustum part seen through the screen rect
+    void getFrustum(const Rect &rect, AABB &box) const
+    {
+        const int32 rx[2] = { rect.x0, rect.x1 };
+        const int32 ry[2] = { rect.y0, rect.y1 };
+
+    // near plane
+        box.minX = box.maxX = 0;
+        box.minY = box.maxY = 0;
+        box.minZ = box.maxZ = 0;
+
+    // far plane
+        for (int32 i = 0; i < 4; i++)
+        {
+            int32 sx = rx[i & 1];
+            int32 sy = ry[i >> 1];
+
+            int32 x = frustumFar.x + frustumFarDX.x * sx / FRAME_WIDTH + frustumFarDY.x * sy / FRAME_HEIGHT;
+            int32 y = frustumFar.y + frustumFarDX.y * sx / FRAME_WIDTH + frustumFarDY.y * sy / FRAME_HEIGHT;
+            int32 z = frustumFar.z + frustumFarDX.z * sx / FRAME_WIDTH + frustumFarDY.z * sy / FRAME_HEIGHT;
+
+            box.minX = X_MIN(box.minX, x);
+            box.maxX = X_MAX(box.maxX, x);
+            box.minY = X_MIN(box.minY, y);
+            box.maxY = X_MAX(box.maxY, y);
+            box.minZ = X_MIN(box.minZ, z);
+            box.maxZ = X_MAX(box.maxZ, z);
+        }
+
+        box.minX += view.pos.x - 1024;
+        box.maxX += view.pos.x + 1024;
+        box.minY += view.pos.y - 1024;
+        box.maxY += view.pos.y + 1024;
+        box.minZ += view.pos.z - 1024;
+        box.maxZ += view.pos.z + 1024;
+    }
+
+    void updateFrustum(const AABB &box, int32 offsetX, int32 offsetY, int32 offsetZ)
+    {
+        frustumAABB.minX = box.minX - offsetX;
+        frustumAABB.maxX = box.maxX - offsetX;
+        frustumAABB.minY = box.minY - offsetY;
+        frustumAABB.maxY = box.maxY - offsetY;
+        frustumAABB.minZ = box.minZ - offsetZ;
+        frustumAABB.maxZ = box.maxZ - offsetZ;
     }
 
     void updateFrustum(int32 offsetX, int32 offsetY, int32 offsetZ)
     {
-        frustumAABB.minX = frustumBase.minX - offsetX;
-        frustumAABB.maxX = frustumBase.maxX - offsetX;
-        frustumAABB.minY = frustumBase.minY - offsetY;
-        frustumAABB.maxY = frustumBase.maxY - offsetY;
-        frustumAABB.minZ = frustumBase.minZ - offsetZ;
-        frustumAABB.maxZ = frustumBase.maxZ - offsetZ;
+        updateFrustum(frustumBase, offsetX, offsetY, offsetZ);
     }
 };
 
@@ -16,10 +16,17 @@
     //#define MODE5
 
     //#define USE_9BIT_SOUND
+    #define USE_OCCLUSION
 #elif defined(__TNS__)
     #define MODE13
 #elif defined(__DOS__)
     #define MODE13
+#elif defined(__linux__) // host benchmark
+    #define MODE4
+    //#define MODE5
+    //#define MODE13
+
+    //#define USE_OCCLUSION
 #else
     #error unsupported platform
 #endif
@@ -44,9 +51,14 @@
     #include <conio.h>
     #include <dos.h>
     #include <mem.h>
+#elif defined(__linux__)
+    #include <stdlib.h>
+    #include <stdint.h>
+    #include <time.h>
 #endif
 
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 #include <math.h>
 #include <limits.h>
@@ -124,6 +136,8 @@ typedef int16              Index;
 
 #if defined(_WIN32)
     #define ASSERT(x) { if (!(x)) { DebugBreak(); } }
+#elif defined(__linux__)
+    #define ASSERT(x) { if (!(x)) { __builtin_trap(); } }
 #else
     #define ASSERT(x)
 #endif
@@ -147,6 +161,11 @@ typedef int16              Index;
     extern uint16 fb[VRAM_WIDTH * FRAME_HEIGHT];
 #elif defined(__DOS__)
     extern uint16 fb[VRAM_WIDTH * FRAME_HEIGHT];
+#elif defined(__linux__)
+    extern uint16 fb[VRAM_WIDTH * FRAME_HEIGHT];
+    #ifdef MODE_PAL
+        extern uint16 MEM_PAL_BG[256];
+    #endif
 #endif
 
 #ifdef PROFILE
@@ -181,6 +200,20 @@ typedef int16              Index;
             REG_TM2CNT_H = 0;\
         }
 
+    #elif defined(__linux__)
+
+        extern timespec g_timer;
+        extern timespec g_current;
+
+        #define PROFILE_START() {\
+            clock_gettime(CLOCK_MONOTONIC, &g_timer);\
+        }
+
+        #define PROFILE_STOP(value) {\
+            clock_gettime(CLOCK_MONOTONIC, &g_current);\
+            value += uint32((g_current.tv_sec - g_timer.tv_sec) * 1000000000 + (g_current.tv_nsec - g_timer.tv_nsec));\
+        }
+
     #else
         #define PROFILE_START()
         #define PROFILE_STOP(value)
@@ -291,8 +324,7 @@ struct VertexUV {
     VertexUV* next;
 };
 
-struct Face { // 12
-    Face*  next;
+struct Face { // 10
     uint16 flags;
     int16  indices[4];
 };
@@ -407,18 +439,19 @@ struct RoomInfo
     uint8 alternateRoom;
     uint8 flags;
 
-    RoomData data;
+    uint32 data[sizeof(RoomData) / sizeof(void*)]; // RoomData offsets
 };
 
 struct Room {
     Item* firstItem;
+    Item** buckets; // items by 2x2 sectors block (see ROOM_BUCKET_SHIFT)
     const RoomInfo* info;
     const Sector* sectors; // == info->sectors (const) by default (see roomModify) 
 
     RoomData data;
 
     Rect clip;
-    uint8 _reserved;
+    bool flat; // no free buckets left, all items are kept in the first one
     bool visible;
 
     void modify();
@@ -426,11 +459,14 @@ struct Room {
 
     void add(Item* item);
     void remove(Item* item);
+    void move(Item* item);
 
+    int32 getBucket(int32 posX, int32 posZ) const;
+    Item** addNearItems(Item** list, const vec3i &pos, int32 radius);
     const Sector* getSector(int32 posX, int32 posZ) const;
     Room* getRoom(int32 x, int32 y, int32 z);
-    bool checkPortal(const Portal* portal);
-    Room** addVisibleRoom(Room** list);
+    bool checkPortal(const Portal* portal, const Rect &view, Rect &rect);
+    Room** addVisibleRoom(Room** list, const Rect &view, const Room* from, int32 depth);
     Room** addNearRoom(Room** list, int32 x, int32 y, int32 z);
     Room** getNearRooms(const vec3i &pos, int32 radius, int32 height);
     Room** getAdjRooms();
@@ -804,8 +840,11 @@ struct Item {
     uint8 type;
     uint8 intensity;
 
+    uint16 bucket;
+
     Item* nextItem;
     Item* nextActive;
+    Item* nextBucket;
 
     static Item* sFirstActive;
     static Item* sFirstFree;
@@ -1082,6 +1121,7 @@ struct Level {
 
     const uint16* palette;
     const uint8* lightmap;
+    const uint8* fogTable;
     const uint8* tiles;
     const RoomInfo* roomsInfo;
     const FloorData* floors;
@@ -1098,14 +1138,14 @@ struct Level {
     const Texture* textures;
     const Sprite* sprites;
     const SpriteSeq* spriteSequences;
-    uint32 cameras;
-    uint32 soundSources;
+    const uint8* cameras;
+    const uint8* soundSources;
     const Box* boxes;
     const uint16* overlaps;
     const uint16* zones[2][3];
-    uint32 animTexData;
+    const uint8* animTexData;
     const ItemInfo* itemsInfo;
-    uint32 cameraFrames;
+    const uint8* cameraFrames;
     const uint16* soundMap;
     const SoundInfo* soundsInfo;
     const uint8* soundData;
@@ -1127,6 +1167,8 @@ extern int32 fps;
     extern uint32 dbg_flush;
     extern uint32 dbg_vert_count;
     extern uint32 dbg_poly_count;
+    extern uint32 dbg_occluded;
+    extern uint32 dbg_sound;
 #endif
 
 #define FIXED_SHIFT     14
@@ -1138,7 +1180,7 @@ extern int32 fps;
 #define SND_VOL_SHIFT   6
 #define SND_PITCH_SHIFT 7
 
-#if defined(_WIN32)
+#if defined(_WIN32) || defined(__linux__)
     #define SND_SAMPLES      1024
     #define SND_OUTPUT_FREQ  22050
     #define SND_SAMPLE_FREQ  22050
@@ -1172,6 +1214,8 @@ extern int32 fps;
 
 #define MAX_UPDATE_FRAMES 10
 
+#define PKD_MAGIC         0x32444B50 // "PKD2" (tools/packer)
+
 #define MAX_MATRICES        8
 #define MAX_ITEMS           256
 #define MAX_MODELS          ITEM_MAX
@@ -1180,11 +1224,21 @@ extern int32 fps;
 #define MAX_VERTICES        3072
 #define MAX_FACES           1024
 #define MAX_ROOM_LIST       16
+#define MAX_ITEM_LIST       64
+#define MAX_TRACKS          64
+#define MAX_PORTAL_DEPTH    16
+
+#define ROOM_BUCKET_SHIFT   11 // 2x2 sectors
+#define ITEM_COLLIDE_RANGE  4096
+#define ITEM_COLLIDE_MARGIN 1024
 
 #define FOV_SHIFT       3
 #define FOG_SHIFT       1
 #define FOG_MAX         (10 * 1024)
 #define FOG_MIN         (FOG_MAX - (8192 >> FOG_SHIFT))
+#define FOG_STEP_SHIFT  (8 - FOG_SHIFT) // one shade per step
+#define FOG_STEPS       (FOG_MAX >> FOG_STEP_SHIFT)
+#define FOG_SHADE(z, g) fogTable[(((z) >> FOG_STEP_SHIFT) << 5) | (g)]
 #define VIEW_MIN_F      (32 << FIXED_SHIFT)
 #define VIEW_MAX_F      (FOG_MAX << FIXED_SHIFT)
 
@@ -1228,8 +1282,10 @@ extern int32 fps;
 #define FixedInvS(x)    ((x < 0) ? -divTable[abs(x)] : divTable[x])
 #define FixedInvU(x)    divTable[x]
 
-#define OT_SHIFT        4
-#define OT_SIZE         ((VIEW_MAX_F >> (FIXED_SHIFT + OT_SHIFT)) + 1)
+// face sort key: depth (z >> FACE_DEPTH_SHIFT) | texture tile, 16 bits for two radix passes
+#define FACE_DEPTH_SHIFT    2
+#define FACE_TILE_BITS      4
+#define FACE_KEY(z, tile)   ((((z) >> FACE_DEPTH_SHIFT) << FACE_TILE_BITS) | ((tile) & ((1 << FACE_TILE_BITS) - 1)))
 
 /*
 #define PERSPECTIVE(x, y, z) {\
@@ -1277,6 +1333,7 @@ extern const uint16 divTable[DIV_TABLE_SIZE];
 // renderer internal
 extern uint32 keys;
 extern AABB   frustumAABB;
+extern uint8  fogTable[FOG_STEPS * 32];
 extern Rect   viewport;
 extern vec3i  cameraViewPos;
 extern Matrix matrixStack[MAX_MATRICES];
@@ -1380,6 +1437,8 @@ bool useSwitch(Item* item, int32 timer);
 bool useKey(Item* item);
 bool usePickup(Item* item);
 
+extern const void* musicTracks[MAX_TRACKS];
+
 void musicPlay(int32 track);
 void musicStop();
 int32 doTutorial(Item* lara, int32 track);
@@ -1400,7 +1459,7 @@ X_INLINE int16 xRand()
 #ifdef __GBA__
     return qran();
 #else 
-    return rand();
+    return rand() & 0x7FFF; // RAND_MAX is wider than 15 bits on glibc
 #endif
 }
 
@@ -204,7 +204,9 @@ void drawRoom(const Room* room)
     matrixPush();
     matrixTranslateAbs(vec3i(info->x << 8, 0, info->z << 8));
 
-    camera.updateFrustum(info->x << 8, 0, info->z << 8);
+    AABB frustum;
+    camera.getFrustum(room->clip, frustum);
+    camera.updateFrustum(frustum, info->x << 8, 0, info->z << 8);
 
     enableClipping = true;
 
@@ -244,7 +246,7 @@ void drawRoom(const Room* room)
         int32 vis = boxIsVisible(&staticMesh->vbox);
         if (vis != 0) {
             enableClipping = vis < 0;
-            drawMesh(staticMesh->meshIndex, mesh->intensity << 5);
+            drawMesh(staticMesh->meshIndex, mesh->intensity << 8);
         }
 
         matrixPop();
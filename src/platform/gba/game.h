@@ -115,7 +115,7 @@ struct Game
         }
 
         if (keys & IK_SELECT) {
-            mixer.playMusic(TRACK_13_WAV);
+            musicPlay(13);
         }
     }
 
@@ -147,6 +147,8 @@ struct Game
                 dbg_flush = 0;
                 dbg_vert_count = 0;
                 dbg_poly_count = 0;
+                dbg_occluded = 0;
+                dbg_sound = 0;
             #endif
 
             drawRooms();
@@ -157,6 +159,7 @@ struct Game
                 drawNumber(dbg_flush, TEXT_POSX, 64);
                 drawNumber(dbg_vert_count, TEXT_POSX, 84);
                 drawNumber(dbg_poly_count, TEXT_POSX, 100);
+                drawNumber(dbg_sound, TEXT_POSX, 116);
             #endif
 
         #endif
@@ -76,6 +76,12 @@ void musicPlay(int32 track)
     if (track > 25 && track < 57) // gym tutorial
     {
         soundPlay(148 + track, camera.view.pos); // play embedded tracks
+        return;
+    }
+
+    if (track < MAX_TRACKS && musicTracks[track])
+    {
+        mixer.playMusic(musicTracks[track]);
     }
 }
 
@@ -127,6 +133,8 @@ void Item::move()
 
     pos.x += phd_sin(realAngle) * hSpeed >> FIXED_SHIFT;
     pos.z += phd_cos(realAngle) * hSpeed >> FIXED_SHIFT;
+
+    room->move(this);
 }
 
 const Anim* Item::animSet(int32 newAnimIndex, bool resetState, int32 frameOffset)
@@ -276,6 +284,7 @@ void Item::skipAnim()
     }
 
     pos = p;
+    room->move(this); // keep the bucket in sync with the restored position
     vSpeed = 0;
     hSpeed = 0;
 }
@@ -386,6 +395,8 @@ void Item::updateRoom(int32 offset)
     {
         room->remove(this);
         nextRoom->add(this);
+    } else {
+        room->move(this);
     }
 
     const Sector* sector = room->getSector(pos.x, pos.z);
@@ -459,6 +470,7 @@ Item::Item(Room* room)
     hSpeed      = 0;
     nextItem    = NULL;
     nextActive  = NULL;
+    nextBucket  = NULL;
     animIndex   = models[type].animIndex;
     frameIndex  = level.anims[animIndex].frameBegin;
     state       = uint8(level.anims[animIndex].state);
@@ -256,28 +256,47 @@ struct Lara : Item
         (this->*sHandlers[state])();
     }
 
+    bool checkCollision(const Item* item) const
+    {
+        vec3i d = pos - item->pos;
+
+        if (abs(d.x) >= ITEM_COLLIDE_RANGE || abs(d.y) >= ITEM_COLLIDE_RANGE || abs(d.z) >= ITEM_COLLIDE_RANGE)
+            return false;
+
+        const Bounds& box = item->getBoundingBox();
+
+        // rotation invariant extents of the item box
+        int32 r = X_MAX(X_MAX(abs(box.minX), abs(box.maxX)), X_MAX(abs(box.minZ), abs(box.maxZ)));
+        r += cinfo.radius + ITEM_COLLIDE_MARGIN;
+
+        if (abs(d.x) >= r || abs(d.z) >= r)
+            return false;
+
+        return (d.y > box.minY - ITEM_COLLIDE_MARGIN) && (d.y - LARA_HEIGHT < box.maxY + ITEM_COLLIDE_MARGIN);
+    }
+
     void updateCollision()
     {
+        Item** list = itemsList;
+
         Room** adjRoom = room->getAdjRooms();
         while (*adjRoom)
         {
-            Item* item = (*adjRoom++)->firstItem;
-            
-            while (item)
+            list = (*adjRoom++)->addNearItems(list, pos, ITEM_COLLIDE_RANGE);
+        }
+        *list++ = NULL;
+
+        Item** nearItem = itemsList;
+        while (*nearItem)
+        {
+            Item* item = *nearItem++;
+
+            if (item->flags.status != ITEM_FLAGS_STATUS_INVISIBLE)
             {
-                if (item->flags.status != ITEM_FLAGS_STATUS_INVISIBLE)
+                if (item->flags.collision && checkCollision(item))
                 {
-                    if (item->flags.collision)
-                    {
-                        vec3i d = pos - item->pos;
-
-                        if (abs(d.x) < 4096 && abs(d.y) < 4096 && abs(d.z) < 4096)
-                        {
-                            item->collide(this, &cinfo);
-                        }
-                    }
+                    item->collide(this, &cinfo);
                 }
-                item = item->nextItem;
             }
         }
 
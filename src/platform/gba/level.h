@@ -13,6 +13,7 @@ extern uint16 palette[256];
 #endif
 
 IWRAM_DATA uint8 lightmap[256 * 32]; // IWRAM 8k
+EWRAM_DATA uint8 fogTable[FOG_STEPS * 32]; // EWRAM 2.5k, lightmap row by depth step and static light
 
 EWRAM_DATA Item items[MAX_ITEMS];
 
@@ -20,6 +21,10 @@ EWRAM_DATA Item items[MAX_ITEMS];
 int32                       dynSectorsCount;
 EWRAM_DATA Sector dynSectors[MAX_DYN_SECTORS];   // EWRAM 8k
 
+#define MAX_ROOM_BUCKETS    4096
+int32                       roomBucketsCount;
+EWRAM_DATA Item* roomBuckets[MAX_ROOM_BUCKETS];  // EWRAM 16k
+
 EWRAM_DATA Room rooms[MAX_ROOMS];
 EWRAM_DATA Model models[MAX_MODELS];
 EWRAM_DATA StaticMesh staticMeshes[MAX_STATIC_MESHES];
@@ -28,6 +33,7 @@ Item* Item::sFirstActive;
 Item* Item::sFirstFree;
 
 Room* roomsList[MAX_ROOM_LIST];
+Item* itemsList[MAX_ITEM_LIST];
 
 void fixLightmap(uint16* palette, int32 palIndex)
 {
@@ -55,14 +61,18 @@ void readLevel(const uint8* data)
     Item::sFirstFree = NULL;
 
     dynSectorsCount = 0;
+    roomBucketsCount = 0;
+
+    memcpy(&level, data, offsetof(Level, palette)); // magic & counts
+
+    ASSERT(level.magic == PKD_MAGIC);
 
-    memcpy(&level, data, sizeof(level));
-    
-    { // fix level data offsets
-        uint32* ptr = (uint32*)&level.palette;
-        while (ptr <= (uint32*)&level.soundOffsets)
+    { // fix level data offsets (stored as 32-bit values, pointers may be wider on the host)
+        const uint32* offset = (uint32*)(data + offsetof(Level, palette));
+        const uint8** ptr = (const uint8**)&level.palette;
+        while (ptr <= (const uint8**)&level.soundOffsets)
         {
-            *ptr++ += (uint32)data;
+            *ptr++ = data + *offset++;
         }
     }
 
@@ -71,16 +81,29 @@ void readLevel(const uint8* data)
         {
             Room* room = rooms + i;
             room->info = level.roomsInfo + i;
-            room->data = room->info->data;
 
-            for (uint32 j = 0; j < sizeof(room->data) / 4; j++)
+            const uint8** ptr = (const uint8**)&room->data;
+            for (uint32 j = 0; j < sizeof(room->data) / sizeof(void*); j++)
             {
-                int32* x = (int32*)&room->data + j;
-                *x += (int32)data;
+                ptr[j] = data + room->info->data[j];
             }
 
             room->sectors = room->data.sectors;
             room->firstItem = NULL;
+
+            int32 bucketsCount = ((room->info->xSectors + 1) >> 1) * ((room->info->zSectors + 1) >> 1);
+
+            // keep one bucket for each of the next rooms, a room that doesn't fit falls back to a flat list
+            room->flat = (roomBucketsCount + bucketsCount > MAX_ROOM_BUCKETS - (level.roomsCount - 1 - i));
+            if (room->flat)
+            {
+                bucketsCount = 1;
+            }
+
+            room->buckets = roomBuckets + roomBucketsCount;
+            memset(room->buckets, 0, bucketsCount * sizeof(Item*));
+            roomBucketsCount += bucketsCount;
+            ASSERT(roomBucketsCount <= MAX_ROOM_BUCKETS);
         }
     }
 
@@ -90,41 +113,18 @@ void readLevel(const uint8* data)
 #endif
 
     memcpy(lightmap, level.lightmap, sizeof(lightmap));
+    memcpy(fogTable, level.fogTable, sizeof(fogTable));
 
     tiles = level.tiles;
 
     textures = level.textures;
 
-    // prepare models // TODO prerocess
-    memset(models, 0, sizeof(models));
-    for (int32 i = 0; i < level.modelsCount; i++)
-    {
-        const Model* model = level.models + i;
-        models[model->type] = *model;
-    }
-
-    //  prepare static meshes // TODO preprocess
-    memset(staticMeshes, 0, sizeof(staticMeshes));
-    for (int32 i = 0; i < level.staticMeshesCount; i++)
-    {
-        const StaticMesh* staticMesh = level.staticMeshes + i;
-
-        ASSERT(staticMesh->id < MAX_STATIC_MESHES);
-        staticMeshes[staticMesh->id] = *staticMesh;
-    }
+    // models, static meshes and sprite sequences are remapped by the packer (tools/packer)
+    ASSERT(level.modelsCount == MAX_MODELS);
+    memcpy(models, level.models, sizeof(models));
 
-    // prepare sprites // TODO preprocess
-    for (int32 i = 0; i < level.spriteSequencesCount; i++)
-    {
-        const SpriteSeq* spriteSeq = level.spriteSequences + i;
-
-        if (spriteSeq->type >= TR1_ITEM_MAX) // WTF?
-            continue;
-
-        Model *m = models + spriteSeq->type;
-        m->count = spriteSeq->count;
-        m->start = spriteSeq->start;
-    }
+    ASSERT(level.staticMeshesCount == MAX_STATIC_MESHES);
+    memcpy(staticMeshes, level.staticMeshes, sizeof(staticMeshes));
 
     // prepare free list
     for (int32 i = MAX_ITEMS - 1; i >= level.itemsCount; i--)
@@ -1,6 +1,5 @@
-#if defined(_WIN32) || defined(__DOS__)
+#if defined(_WIN32) || defined(__DOS__) || defined(__linux__)
     void* LEVEL1_PKD;
-    void* TRACK_13_WAV;
 #elif defined(__GBA__)
     #include "LEVEL1_PKD.h"
     #include "TRACK_13_WAV.h"
@@ -12,6 +11,8 @@
 
 Game game;
 
+const void* musicTracks[MAX_TRACKS]; // by track index, played directly from ROM on GBA
+
 int32 fps;
 int32 frameIndex = 0;
 int32 fpsCounter = 0;
@@ -239,6 +240,100 @@ int32 fpsCounter = 0;
         if (keyState[KB_ENTER])   keys |= IK_START;
         if (keyState[KB_TAB])     keys |= IK_SELECT;
     }
+#elif defined(__linux__)
+    // off-screen benchmark, replays the camera path and writes PROFILE counters per frame
+    #if defined(MODE_PAL)
+        #define SCREEN_WIDTH    FRAME_WIDTH
+        #define SCREEN_HEIGHT   FRAME_HEIGHT
+    #elif defined(ROTATE90_MODE)
+        #define SCREEN_WIDTH    FRAME_HEIGHT
+        #define SCREEN_HEIGHT   FRAME_WIDTH
+    #else
+        #define SCREEN_WIDTH    VRAM_WIDTH
+        #define SCREEN_HEIGHT   FRAME_HEIGHT
+    #endif
+
+    uint32 SCREEN[SCREEN_WIDTH * SCREEN_HEIGHT];
+
+    #ifdef MODE_PAL
+        uint16 MEM_PAL_BG[256];
+    #endif
+
+    #ifdef PROFILE
+        timespec g_timer;
+        timespec g_current;
+    #endif
+
+    void paletteSet(const uint16* palette)
+    {
+    #ifdef MODE_PAL
+        memcpy(MEM_PAL_BG, palette, 256 * 2);
+    #endif
+    }
+
+    uint32 getTimeNS()
+    {
+        timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return uint32(t.tv_sec * 1000000000 + t.tv_nsec);
+    }
+
+    void blit() {
+    #ifdef MODE_PAL
+        for (int i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; i++) {
+            uint16 c = MEM_PAL_BG[((uint8*)fb)[i]];
+            SCREEN[i] = (((c << 3) & 0xFF) << 16) | ((((c >> 5) << 3) & 0xFF) << 8) | ((c >> 10 << 3) & 0xFF) | 0xFF000000;
+        }
+    #elif defined(ROTATE90_MODE)
+        for (int i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; i++) {
+            int32 x = FRAME_HEIGHT - (i % FRAME_HEIGHT) - 1;
+            int32 y = i / FRAME_HEIGHT;
+            uint16 c = ((uint16*)fb)[x * FRAME_WIDTH + y];
+            SCREEN[i] = (((c << 3) & 0xFF) << 16) | ((((c >> 5) << 3) & 0xFF) << 8) | ((c >> 10 << 3) & 0xFF) | 0xFF000000;
+        }
+    #else
+        for (int i = 0; i < VRAM_WIDTH * FRAME_HEIGHT; i++) {
+            uint16 c = ((uint16*)fb)[i];
+            SCREEN[i] = (((c << 3) & 0xFF) << 16) | ((((c >> 5) << 3) & 0xFF) << 8) | ((c >> 10 << 3) & 0xFF) | 0xFF000000;
+        }
+    #endif
+    }
+
+    void saveScreen(const char* name)
+    {
+        FILE* f = fopen(name, "wb");
+        if (!f) {
+            return;
+        }
+
+        fprintf(f, "P6\n%d %d\n255\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+        for (int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++) {
+            uint8 rgb[3] = { uint8(SCREEN[i] >> 16), uint8(SCREEN[i] >> 8), uint8(SCREEN[i]) };
+            fwrite(rgb, 1, 3, f);
+        }
+        fclose(f);
+    }
+
+    #define BENCH_VIEW_FRAMES   64
+    #define BENCH_VIEW_HEIGHT   768
+
+    // LEVEL1 camera path, the view turns around at every point
+    struct BenchView {
+        int16 roomIndex;
+        vec3i pos;
+    };
+
+    const BenchView benchPath[] = {
+        {  0, vec3i(74588, 3072, 19673) }, // first darts
+        {  9, vec3i(49669, 7680, 57891) }, // first door
+        { 10, vec3i(43063, 7168, 61198) }, // transp
+        { 14, vec3i(20215, 6656, 52942) }, // bridge
+        { 17, vec3i(16475, 6656, 59845) }, // bear
+        { 26, vec3i(24475, 6912, 83505) }, // switch timer
+        { 35, vec3i(35149, 2048, 74189) }, // switch timer
+    };
+
+    #define BENCH_VIEWS (sizeof(benchPath) / sizeof(benchPath[0]))
 #endif
 
 #ifdef PROFILE
@@ -247,6 +342,8 @@ int32 fpsCounter = 0;
     uint32 dbg_flush;
     uint32 dbg_vert_count;
     uint32 dbg_poly_count;
+    uint32 dbg_occluded;
+    uint32 dbg_sound;
 #endif
 
 EWRAM_DATA ALIGN16 uint8 soundBufferA[2 * SND_SAMPLES + 32]; // 32 bytes of silence for DMA overrun while interrupt
@@ -317,6 +414,11 @@ void soundFill()
     #endif
     }
 
+#ifdef PROFILE // timer 3, the interrupt can break into the PROFILE_START section of timer 2
+    REG_TM3CNT_L = 0;
+    REG_TM3CNT_H = (1 << 7) | TIMER_FREQ_DIV;
+#endif
+
     mixer.fill(soundBufferA + curSoundBuffer * SND_SAMPLES,
                #ifdef USE_9BIT_SOUND
                    soundBufferB + curSoundBuffer * SND_SAMPLES,
@@ -325,6 +427,11 @@ void soundFill()
                #endif
                SND_SAMPLES);
     curSoundBuffer ^= 1;
+
+#ifdef PROFILE
+    dbg_sound += REG_TM3CNT_L;
+    REG_TM3CNT_H = 0;
+#endif
 }
 #endif
 
@@ -414,11 +521,11 @@ void vblank() {
 
 #endif
 
-int main(void) {
-#if defined(_WIN32) || defined(__TNS__) || defined(__DOS__)
+int main(int argc, char** argv) {
+#if defined(_WIN32) || defined(__TNS__) || defined(__DOS__) || defined(__linux__)
     {
     // level1
-        #if defined(_WIN32) || defined(__DOS__)
+        #if defined(_WIN32) || defined(__DOS__) || defined(__linux__)
             FILE *f = fopen("data/LEVEL1.PKD", "rb");
         #elif defined(__TNS__)
             FILE *f = fopen("/documents/OpenLara/LEVEL1.PHD.tns", "rb");
@@ -437,24 +544,32 @@ int main(void) {
         fread(LEVEL1_PKD, 1, size, f);
         fclose(f);
 
-    // track 13
-        #if defined(_WIN32) || defined(__DOS__)
+    // music tracks (optional)
+        #if defined(_WIN32) || defined(__DOS__) || defined(__linux__)
+        for (int32 i = 0; i < MAX_TRACKS; i++)
         {
-            FILE *f = fopen("data/TRACK_13.WAV", "rb");
+            char name[32];
+            sprintf(name, "data/TRACK_%02d.WAV", i);
+
+            FILE *f = fopen(name, "rb");
             if (!f) {
-                return 0;
+                continue;
             }
 
             fseek(f, 0, SEEK_END);
             int32 size = ftell(f);
             fseek(f, 0, SEEK_SET);
-            TRACK_13_WAV = new uint8[size];
-            fread(TRACK_13_WAV, 1, size, f);
+            uint8* data = new uint8[size];
+            fread(data, 1, size, f);
             fclose(f);
+
+            musicTracks[i] = data;
         }
         #endif
     }
 #elif defined(__GBA__)
+    musicTracks[13] = TRACK_13_WAV;
+
     // set low latency mode via WAITCNT register (thanks to GValiente)
     REG_WSCNT = WS_ROM0_N2 | WS_ROM0_S1 | WS_PREFETCH;
     //*(vu32*)(REG_BASE+0x0800) = 0x0E000020; // Undocumented - Internal Memory Control (R/W)
@@ -649,6 +764,82 @@ int main(void) {
 
     inputRelease();
     videoRelease();
+#elif defined(__linux__)
+    const char* csvName = "profile.csv";
+    bool screenshots = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-s")) {
+            screenshots = true;
+        } else {
+            csvName = argv[i];
+        }
+    }
+
+    FILE* csv = fopen(csvName, "w");
+    if (!csv) {
+        return 1;
+    }
+
+    mixer.init();
+
+    game.init();
+
+    camera.mode = CAMERA_MODE_FREE;
+
+    fprintf(csv, "frame,view,room,angle,transform,poly,flush,vertices,faces,occluded,sound,render\n");
+
+    int32 frame = 0;
+
+    for (uint32 i = 0; i < BENCH_VIEWS; i++)
+    {
+        const BenchView &v = benchPath[i];
+
+        for (int32 j = 0; j < BENCH_VIEW_FRAMES; j++, frame++)
+        {
+            camera.view.room = rooms + v.roomIndex;
+            camera.view.pos = vec3i(v.pos.x, v.pos.y - BENCH_VIEW_HEIGHT, v.pos.z);
+            camera.angleX = 0;
+            camera.angleY = int16(j * (0x10000 / BENCH_VIEW_FRAMES));
+
+            game.update(1);
+
+            uint32 startTime = getTimeNS();
+            game.render();
+            uint32 renderTime = getTimeNS() - startTime;
+
+            blit();
+
+        // one mixer buffer per frame, the music is restarted to keep the decoder busy
+            if (!mixer.music.data) {
+                musicPlay(13);
+            }
+
+            PROFILE_START();
+            mixer.fill(soundBufferA + curSoundBuffer * SND_SAMPLES, NULL, SND_SAMPLES);
+            PROFILE_STOP(dbg_sound);
+            curSoundBuffer ^= 1;
+
+            if (screenshots && j == 0)
+            {
+                char name[32];
+                sprintf(name, "view_%02d.ppm", i);
+                saveScreen(name);
+            }
+
+        #ifdef PROFILE
+            fprintf(csv, "%d,%d,%d,%d,%u,%u,%u,%u,%u,%u,%u,%u\n", frame, i, int32(camera.view.room - rooms), camera.angleY & 0xFFFF,
+                    dbg_transform, dbg_poly, dbg_flush, dbg_vert_count, dbg_poly_count, dbg_occluded, dbg_sound, renderTime);
+        #else
+            fprintf(csv, "%d,%d,%d,%d,0,0,0,0,0,0,0,%u\n", frame, i, int32(camera.view.room - rooms), camera.angleY & 0xFFFF, renderTime);
+        #endif
+        }
+    }
+
+    fclose(csv);
+
+    printf("%d frames -> %s\n", frame, csvName);
 #endif
     return 0;
 }
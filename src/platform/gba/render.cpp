@@ -8,6 +8,8 @@
     uint16 fb[VRAM_WIDTH * FRAME_HEIGHT];
 #elif defined(__DOS__)
     uint16 fb[VRAM_WIDTH * FRAME_HEIGHT];
+#elif defined(__linux__)
+    uint16 fb[VRAM_WIDTH * FRAME_HEIGHT];
 #endif
 
 #define GUARD_BAND 512
@@ -40,13 +42,28 @@ extern const uint8* tiles;
 const uint8* tile;
 
 uint32 gVerticesCount = 0;
-int32 gFacesCount = 0; // 1 is reserved as OT terminator
+int32 gFacesCount = 0;
 
 EWRAM_DATA Vertex gVertices[MAX_VERTICES]; // EWRAM 16k
-EWRAM_DATA Face gFaces[MAX_FACES];         // EWRAM 5k
-EWRAM_DATA Face* otFaces[OT_SIZE] = { 0 };
-int32 otMin = OT_SIZE - 1;
-int32 otMax = 0;
+EWRAM_DATA Face gFaces[MAX_FACES];         // EWRAM 10k
+EWRAM_DATA uint32 gFaceKeys[MAX_FACES];    // EWRAM 4k, key << 16 | face index
+EWRAM_DATA uint32 gFaceKeysTmp[MAX_FACES]; // EWRAM 4k
+
+#ifdef USE_OCCLUSION
+// coarse coverage of the opaque faces drawn in front, one bit per block
+#if FRAME_WIDTH > 256
+    #define OCC_SHIFT   4
+#else
+    #define OCC_SHIFT   3
+#endif
+#define OCC_SIZE        (1 << OCC_SHIFT)
+#define OCC_COLS        ((FRAME_WIDTH + OCC_SIZE - 1) >> OCC_SHIFT)
+#define OCC_ROWS        ((FRAME_HEIGHT + OCC_SIZE - 1) >> OCC_SHIFT)
+#define OCC_MARGIN      2 // in pixels, covers the rasterizer rounding
+#define OCC_MIN_SIZE    (OCC_SIZE * 3)
+
+uint32 occMask[OCC_ROWS];
+#endif
 
 bool enableAlphaTest;
 bool enableClipping;
@@ -143,16 +160,7 @@ void transform(int32 vx, int32 vy, int32 vz, int32 vg)
 
     int32 fogZ = z >> FIXED_SHIFT;
     res.z = fogZ;
-
-    if (fogZ > FOG_MIN)
-    {
-        vg += (fogZ - FOG_MIN) << FOG_SHIFT;
-        if (vg > 8191) {
-            vg = 8191;
-        }
-    }
-
-    res.g = vg >> 8;
+    res.g = FOG_SHADE(fogZ, vg >> 8);
 
     PERSPECTIVE(x, y, z);
 
@@ -197,18 +205,7 @@ void transformRoomVertex(const RoomVertex* v)
 
     int32 fogZ = z >> FIXED_SHIFT;
     res.z = fogZ;
-
-    int32 vg = v->g << 5;
-
-    if (fogZ > FOG_MIN)
-    {
-        vg += (fogZ - FOG_MIN) << FOG_SHIFT;
-        if (vg > 8191) {
-            vg = 8191;
-        }
-    }
-
-    res.g = vg >> 8;
+    res.g = FOG_SHADE(fogZ, v->g); // static light is stored as the lightmap row
 
     int32 x = DP43c(m[0], vx, vy, vz);
     int32 y = DP43c(m[1], vx, vy, vz);
@@ -372,6 +369,9 @@ void drawTriangle(const Face* face, VertexUV *v)
         }
     }
 
+    if (top->v.y == top->next->v.y && top->v.y == top->prev->v.y) // edge-on
+        return;
+
     rasterize(face, top);
 }
 
@@ -407,6 +407,9 @@ void drawQuad(const Face* face, VertexUV *v)
         }
     }
 
+    if (v1->v.y == v2->v.y && v1->v.y == v3->v.y && v1->v.y == v4->v.y) // edge-on
+        return;
+
     rasterize(face, top);
 }
 
@@ -536,14 +539,11 @@ void drawGlyph(const Sprite *sprite, int32 x, int32 y)
     }
 }
 
-X_INLINE void faceAddToOTable(Face* face, int32 depth)
+X_INLINE void faceAddKey(uint32 flags, int32 depth)
 {
-    ASSERT(depth < OT_SIZE);
-    face->next = otFaces[depth];
-    otFaces[depth] = face;
-
-    if (depth < otMin) otMin = depth;
-    if (depth > otMax) otMax = depth;
+    ASSERT(depth >= 0 && depth < (VIEW_MAX_F >> FIXED_SHIFT));
+    int32 tile = (flags & FACE_COLORED) ? 0 : textures[flags & FACE_TEXTURE].tile;
+    gFaceKeys[gFacesCount] = (FACE_KEY(depth, tile) << 16) | gFacesCount;
 }
 
 void faceAddQuad(uint32 flags, const Index* indices, int32 startVertex)
@@ -573,15 +573,16 @@ void faceAddQuad(uint32 flags, const Index* indices, int32 startVertex)
         flags |= FACE_FLAT;
     }
 
-    int32 depth = X_MAX(v1->z, X_MAX(v2->z, X_MAX(v3->z, v4->z))) >> OT_SHIFT;
+    int32 depth = X_MAX(v1->z, X_MAX(v2->z, X_MAX(v3->z, v4->z)));
 
     // z-bias hack for the shadow plane
     if (flags & FACE_SHADOW) {
-        depth = X_MAX(0, depth - 8);
+        depth = X_MAX(0, depth - 128);
     }
 
+    faceAddKey(flags, depth);
+
     Face *f = gFaces + gFacesCount++;
-    faceAddToOTable(f, depth);
 
     f->flags      = uint16(flags);
     f->indices[0] = startVertex + indices[0];
@@ -616,10 +617,11 @@ void faceAddTriangle(uint32 flags, const Index* indices, int32 startVertex)
         flags |= FACE_FLAT;
     }
 
-    int32 depth = X_MAX(v1->z, X_MAX(v2->z, v3->z)) >> OT_SHIFT;
+    int32 depth = X_MAX(v1->z, X_MAX(v2->z, v3->z));
+
+    faceAddKey(flags, depth);
 
     Face *f = gFaces + gFacesCount++;
-    faceAddToOTable(f, depth);
 
     f->flags      = uint16(flags | FACE_TRIANGLE);
     f->indices[0] = startVertex + indices[0];
@@ -661,60 +663,274 @@ void faceAddMesh(const Quad* rFaces, const Quad* crFaces, const Triangle* tFaces
     int32 gFacesCountMax, gVerticesCountMax;
 #endif
 
+// two 8-bit LSD passes over the 16-bit key, stable for the equal keys
+void faceSort()
+{
+    uint16 count0[256];
+    uint16 count1[256];
+
+    memset(count0, 0, sizeof(count0));
+    memset(count1, 0, sizeof(count1));
+
+    for (int32 i = 0; i < gFacesCount; i++)
+    {
+        uint32 key = gFaceKeys[i];
+        count0[(key >> 16) & 0xFF]++;
+        count1[key >> 24]++;
+    }
+
+    uint32 sum0 = 0, sum1 = 0;
+    for (int32 i = 0; i < 256; i++)
+    {
+        uint32 c0 = count0[i];
+        uint32 c1 = count1[i];
+        count0[i] = sum0;
+        count1[i] = sum1;
+        sum0 += c0;
+        sum1 += c1;
+    }
+
+    for (int32 i = 0; i < gFacesCount; i++)
+    {
+        uint32 key = gFaceKeys[i];
+        gFaceKeysTmp[count0[(key >> 16) & 0xFF]++] = key;
+    }
+
+    for (int32 i = 0; i < gFacesCount; i++)
+    {
+        uint32 key = gFaceKeysTmp[i];
+        gFaceKeys[count1[key >> 24]++] = key;
+    }
+}
+
+#ifdef USE_OCCLUSION
+X_INLINE bool faceIsOpaque(uint32 flags)
+{
+    if (flags & FACE_SHADOW)
+        return false;
+    return (flags & FACE_COLORED) || (textures[flags & FACE_TEXTURE].attribute != 1);
+}
+
+struct OccEdge {
+    int32 x, y, dy;
+    int32 slope; // 16.16
+};
+
+// horizontal extent of the convex front-facing polygon at the row y
+bool occlusionSpan(const OccEdge* edges, int32 count, int32 y, int32 &x0, int32 &x1)
+{
+    x0 = INT_MIN;
+    x1 = INT_MAX;
+
+    for (int32 i = 0; i < count; i++)
+    {
+        const OccEdge &e = edges[i];
+
+        int32 t = y - e.y;
+        int32 x = e.x + int32((int64(t) * e.slope) >> 16);
+
+        if (e.dy > 0) { // right edge
+            if (t >= 0 && t <= e.dy) x1 = X_MIN(x1, x);
+        } else { // left edge
+            if (t <= 0 && t >= e.dy) x0 = X_MAX(x0, x);
+        }
+    }
+
+    return x0 != INT_MIN && x1 != INT_MAX;
+}
+
+// marks the blocks that lie completely inside of the convex front-facing face
+void occlusionAdd(const Vertex** v, int32 count, const Rect &rect)
+{
+    OccEdge edges[4];
+    int32 edgesCount = 0;
+
+    for (int32 i = 0; i < count; i++)
+    {
+        const Vertex* a = v[i];
+        const Vertex* b = v[(i + 1) % count];
+        const Vertex* c = v[(i + 2) % count];
+
+        int32 dx = b->x - a->x;
+        int32 dy = b->y - a->y;
+
+        if (dx * (c->y - a->y) - dy * (c->x - a->x) <= 0)
+            return; // back-facing, concave or degenerate
+
+        if (dy == 0)
+            continue; // horizontal edges are the ends of the spans
+
+        OccEdge &e = edges[edgesCount++];
+        e.x     = a->x;
+        e.y     = a->y;
+        e.dy    = dy;
+        e.slope = (dx << 16) / dy;
+    }
+
+    int32 y0 = (rect.y0 + OCC_SIZE - 1) >> OCC_SHIFT;
+    int32 y1 = X_MIN(rect.y1 >> OCC_SHIFT, OCC_ROWS);
+
+    for (int32 y = y0; y < y1; y++)
+    {
+        int32 ax0, ax1, bx0, bx1;
+
+        if (!occlusionSpan(edges, edgesCount, (y << OCC_SHIFT) - OCC_MARGIN, ax0, ax1) ||
+            !occlusionSpan(edges, edgesCount, ((y + 1) << OCC_SHIFT) + OCC_MARGIN, bx0, bx1))
+            continue;
+
+        int32 x0 = X_MAX(X_MAX(ax0, bx0) + OCC_MARGIN, rect.x0);
+        int32 x1 = X_MIN(X_MIN(ax1, bx1) - OCC_MARGIN, rect.x1);
+
+        x0 = (x0 + OCC_SIZE - 1) >> OCC_SHIFT;
+        x1 = X_MIN(x1 >> OCC_SHIFT, OCC_COLS);
+
+        if (x0 < x1) {
+            occMask[y] |= (1 << x1) - (1 << x0);
+        }
+    }
+}
+
+// front to back pass, drops the faces hidden behind the blocks covered by the nearer opaque faces
+void faceOcclusion()
+{
+    memset(occMask, 0, sizeof(occMask));
+
+    Rect frame(0, 0, FRAME_WIDTH, FRAME_HEIGHT);
+
+    int32 count = 0;
+
+    for (int32 i = 0; i < gFacesCount; i++)
+    {
+        uint32 key = gFaceKeys[i];
+        const Face* face = gFaces + (key & 0xFFFF);
+        uint32 flags = face->flags;
+
+        int32 vCount = (flags & FACE_TRIANGLE) ? 3 : 4;
+        const Vertex* v[4];
+
+        Rect rect(INT_MAX, INT_MAX, INT_MIN, INT_MIN);
+
+        bool guard = false;
+
+        for (int32 j = 0; j < vCount; j++)
+        {
+            const Vertex* p = v[j] = gVertices + face->indices[j];
+
+            rect.x0 = X_MIN(rect.x0, p->x);
+            rect.y0 = X_MIN(rect.y0, p->y);
+            rect.x1 = X_MAX(rect.x1, p->x);
+            rect.y1 = X_MAX(rect.y1, p->y);
+
+            guard |= (abs(p->x - (FRAME_WIDTH >> 1)) >= GUARD_BAND) || (abs(p->y - (FRAME_HEIGHT >> 1)) >= GUARD_BAND);
+        }
+
+        const Rect &clip = (flags & FACE_CLIPPED) ? viewport : frame;
+
+        int32 x0 = X_MAX(rect.x0, clip.x0);
+        int32 y0 = X_MAX(rect.y0, clip.y0);
+        int32 x1 = X_MIN(rect.x1, clip.x1 - 1);
+        int32 y1 = X_MIN(rect.y1, clip.y1 - 1);
+
+        if (x0 <= x1 && y0 <= y1)
+        {
+            x0 >>= OCC_SHIFT;
+            x1 >>= OCC_SHIFT;
+            y0 >>= OCC_SHIFT;
+            y1 >>= OCC_SHIFT;
+
+            uint32 bits = (uint32(2) << x1) - (1 << x0);
+
+            int32 y = y0;
+            while (y <= y1 && (occMask[y] & bits) == bits)
+            {
+                y++;
+            }
+
+            if (y > y1)
+                continue; // hidden
+        }
+
+        gFaceKeys[count++] = key;
+
+        if (guard || !faceIsOpaque(flags))
+            continue;
+
+        if (rect.x1 - rect.x0 < OCC_MIN_SIZE || rect.y1 - rect.y0 < OCC_MIN_SIZE)
+            continue;
+
+        if (flags & FACE_CLIPPED)
+        {
+            rect.x0 = X_MAX(rect.x0, clip.x0);
+            rect.y0 = X_MAX(rect.y0, clip.y0);
+            rect.x1 = X_MIN(rect.x1, clip.x1);
+            rect.y1 = X_MIN(rect.y1, clip.y1);
+        }
+
+        occlusionAdd(v, vCount, rect);
+    }
+
+#ifdef PROFILE
+    dbg_occluded += gFacesCount - count;
+#endif
+
+    gFacesCount = count;
+}
+#endif
+
 void flush()
 {
     if (gFacesCount)
     {
         PROFILE_START();
-        for (int32 i = otMax; i >= otMin; i--)
-        {
-            if (!otFaces[i]) continue;
 
-            Face *face = otFaces[i];
-            otFaces[i] = NULL;
+    #ifdef PROFILE
+        dbg_poly_count += gFacesCount;
+    #endif
 
-            do {
-                VertexUV v[16];
+        faceSort();
+    #ifdef USE_OCCLUSION
+        faceOcclusion();
+    #endif
 
-                uint32 flags = face->flags;
+        VertexUV v[16];
 
-                if (!(flags & FACE_COLORED))
-                {
-                    const Texture &tex = textures[face->flags & FACE_TEXTURE];
-                    tile = tiles + (tex.tile << 16);
+        for (int32 i = gFacesCount - 1; i >= 0; i--)
+        {
+            Face *face = gFaces + (gFaceKeys[i] & 0xFFFF);
 
-                    v[0].t.uv = tex.uv0;
-                    v[1].t.uv = tex.uv1;
-                    v[2].t.uv = tex.uv2;
-                    v[3].t.uv = tex.uv3;
-                    enableAlphaTest = (tex.attribute == 1);
-                }
+            uint32 flags = face->flags;
 
-                v[0].v = gVertices[face->indices[0]];
-                v[1].v = gVertices[face->indices[1]];
-                v[2].v = gVertices[face->indices[2]];
-                if (!(flags & FACE_TRIANGLE)) {
-                    v[3].v = gVertices[face->indices[3]];
-                }
+            if (!(flags & FACE_COLORED))
+            {
+                const Texture &tex = textures[face->flags & FACE_TEXTURE];
+                tile = tiles + (tex.tile << 16);
+
+                v[0].t.uv = tex.uv0;
+                v[1].t.uv = tex.uv1;
+                v[2].t.uv = tex.uv2;
+                v[3].t.uv = tex.uv3;
+                enableAlphaTest = (tex.attribute == 1);
+            }
+
+            v[0].v = gVertices[face->indices[0]];
+            v[1].v = gVertices[face->indices[1]];
+            v[2].v = gVertices[face->indices[2]];
+            if (!(flags & FACE_TRIANGLE)) {
+                v[3].v = gVertices[face->indices[3]];
+            }
 
-                if (flags & FACE_CLIPPED) {
-                    drawPoly(face, v);
+            if (flags & FACE_CLIPPED) {
+                drawPoly(face, v);
+            } else {
+                if (flags & FACE_TRIANGLE) {
+                    drawTriangle(face, v);
                 } else {
-                    if (flags & FACE_TRIANGLE) {
-                        drawTriangle(face, v);
-                    } else {
-                        drawQuad(face, v);
-                    }
-                };
-
-                face = face->next;
-            } while (face);
+                    drawQuad(face, v);
+                }
+            }
         }
 
         PROFILE_STOP(dbg_flush);
-
-        otMin = OT_SIZE - 1;
-        otMax = 0;
     }
 
 #ifdef DEBUG_FACES
@@ -728,7 +944,6 @@ void flush()
 
 #ifdef PROFILE
     dbg_vert_count += gVerticesCount;
-    dbg_poly_count += gFacesCount;
 #endif
 
     gVerticesCount = 0;
@@ -339,7 +339,7 @@ int32 Room::getWaterDepth()
     return WALL; // TODO
 }
 
-bool Room::checkPortal(const Portal* portal)
+bool Room::checkPortal(const Portal* portal, const Rect &view, Rect &rect)
 {
     vec3i d;
     d.x = portal->v[0].x - cameraViewPos.x + (info->x << 8);
@@ -350,10 +350,10 @@ bool Room::checkPortal(const Portal* portal)
         return false;
     }
 
-    int32 x0 = clip.x1;
-    int32 y0 = clip.y1;
-    int32 x1 = clip.x0;
-    int32 y1 = clip.y0;
+    int32 x0 = view.x1;
+    int32 y0 = view.y1;
+    int32 x1 = view.x0;
+    int32 y1 = view.y0;
 
     int32 znear = 0, zfar = 0;
 
@@ -432,47 +432,55 @@ bool Room::checkPortal(const Portal* portal)
         }
     }
 
-    if (x0 < clip.x0) x0 = clip.x0;
-    if (x1 > clip.x1) x1 = clip.x1;
-    if (y0 < clip.y0) y0 = clip.y0;
-    if (y1 > clip.y1) y1 = clip.y1;
+    if (x0 < view.x0) x0 = view.x0;
+    if (x1 > view.x1) x1 = view.x1;
+    if (y0 < view.y0) y0 = view.y0;
+    if (y1 > view.y1) y1 = view.y1;
 
     if (x0 >= x1 || y0 >= y1) return false;
 
-    Room* nextRoom = rooms + portal->roomIndex;
-
-    if (x0 < nextRoom->clip.x0) nextRoom->clip.x0 = x0;
-    if (x1 > nextRoom->clip.x1) nextRoom->clip.x1 = x1;
-    if (y0 < nextRoom->clip.y0) nextRoom->clip.y0 = y0;
-    if (y1 > nextRoom->clip.y1) nextRoom->clip.y1 = y1;
+    rect = Rect( x0, y0, x1, y1 );
 
     return true;
 }
 
-Room** Room::addVisibleRoom(Room** list)
+// recursive traversal, every portal shrinks the view rect of the path
+// the room clip is the union of the rects of all paths reaching the room
+Room** Room::addVisibleRoom(Room** list, const Rect &view, const Room* from, int32 depth)
 {
-    matrixPush();
-    matrixTranslateAbs(vec3i(info->x << 8, 0, info->z << 8));
+    if (depth >= MAX_PORTAL_DEPTH)
+        return list;
+
+    vec3i pos(info->x << 8, 0, info->z << 8);
+    matrixTranslateAbs(pos);
 
     for (int32 i = 0; i < info->portalsCount; i++)
     {
         const Portal* portal = data.portals + i;
+        Room* nextRoom = rooms + portal->roomIndex;
 
-        if (checkPortal(portal))
-        {
-            Room* nextRoom = rooms + portal->roomIndex;
+        if (nextRoom == from)
+            continue;
 
-            list = nextRoom->addVisibleRoom(list);
+        Rect rect;
+        if (!checkPortal(portal, view, rect))
+            continue;
 
-            if (!nextRoom->visible) {
-                nextRoom->visible = true;
-                *list++ = nextRoom;
-            }
+        Rect &clip = nextRoom->clip;
+        if (rect.x0 < clip.x0) clip.x0 = rect.x0;
+        if (rect.x1 > clip.x1) clip.x1 = rect.x1;
+        if (rect.y0 < clip.y0) clip.y0 = rect.y0;
+        if (rect.y1 > clip.y1) clip.y1 = rect.y1;
+
+        list = nextRoom->addVisibleRoom(list, rect, this, depth + 1);
+        matrixTranslateAbs(pos); // the next room has moved the shared matrix
+
+        if (!nextRoom->visible && list - roomsList < MAX_ROOM_LIST - 2) { // keep the slots for this room and the terminator
+            nextRoom->visible = true;
+            *list++ = nextRoom;
         }
     }
 
-    matrixPop();
-
     return list;
 }
 
@@ -480,7 +488,11 @@ Room** Room::getVisibleRooms()
 {
     Room** list = roomsList;
 
-    list = addVisibleRoom(list);
+    visible = true;
+
+    matrixPush(); // one matrix for the whole traversal, rooms only change its translation
+    list = addVisibleRoom(list, clip, NULL, 0);
+    matrixPop();
     *list++ = this;
     *list++ = NULL;
 
@@ -558,46 +570,115 @@ void Room::modify()
     }
 }
 
-void Room::add(Item* item)
+int32 Room::getBucket(int32 posX, int32 posZ) const
 {
-    ASSERT(item && item->nextItem == NULL);
+    if (flat)
+        return 0;
 
-    item->room = this;
-    item->nextItem = firstItem;
-    firstItem = item;
+    int32 bx = X_CLAMP((posX - (info->x << 8)) >> ROOM_BUCKET_SHIFT, 0, (info->xSectors - 1) >> 1);
+    int32 bz = X_CLAMP((posZ - (info->z << 8)) >> ROOM_BUCKET_SHIFT, 0, (info->zSectors - 1) >> 1);
+
+    return bx * ((info->zSectors + 1) >> 1) + bz;
 }
 
-void Room::remove(Item* item)
+void removeFromList(Item** first, Item* item, Item* Item::*next)
 {
-    ASSERT(item && item->room == this);
-
-    item->room = NULL;
-
     Item* prev = NULL;
-    Item* curr = firstItem;
+    Item* curr = *first;
 
     while (curr)
     {
-        Item* next = curr->nextItem;
+        Item* n = curr->*next;
 
         if (curr == item)
         {
-            item->nextItem = NULL;
+            item->*next = NULL;
 
             if (prev) {
-                prev->nextItem = next;
+                prev->*next = n;
             } else {
-                firstItem = next;
+                *first = n;
             }
 
             break;
         }
 
         prev = curr;
-        curr = next;
+        curr = n;
     }
 }
 
+void Room::add(Item* item)
+{
+    ASSERT(item && item->nextItem == NULL && item->nextBucket == NULL);
+
+    item->room = this;
+    item->nextItem = firstItem;
+    firstItem = item;
+
+    item->bucket = getBucket(item->pos.x, item->pos.z);
+    item->nextBucket = buckets[item->bucket];
+    buckets[item->bucket] = item;
+}
+
+void Room::remove(Item* item)
+{
+    ASSERT(item && item->room == this);
+
+    item->room = NULL;
+
+    removeFromList(&firstItem, item, &Item::nextItem);
+    removeFromList(buckets + item->bucket, item, &Item::nextBucket);
+}
+
+void Room::move(Item* item)
+{
+    ASSERT(item && item->room == this);
+
+    int32 bucket = getBucket(item->pos.x, item->pos.z);
+
+    if (bucket == item->bucket)
+        return;
+
+    removeFromList(buckets + item->bucket, item, &Item::nextBucket);
+
+    item->bucket = bucket;
+    item->nextBucket = buckets[bucket];
+    buckets[bucket] = item;
+}
+
+Item** Room::addNearItems(Item** list, const vec3i &pos, int32 radius)
+{
+    int32 rx = info->x << 8;
+    int32 rz = info->z << 8;
+    int32 zBuckets = (info->zSectors + 1) >> 1;
+
+    int32 minX = X_CLAMP((pos.x - radius - rx) >> ROOM_BUCKET_SHIFT, 0, (info->xSectors - 1) >> 1);
+    int32 minZ = X_CLAMP((pos.z - radius - rz) >> ROOM_BUCKET_SHIFT, 0, (info->zSectors - 1) >> 1);
+    int32 maxX = X_CLAMP((pos.x + radius - rx) >> ROOM_BUCKET_SHIFT, 0, (info->xSectors - 1) >> 1);
+    int32 maxZ = X_CLAMP((pos.z + radius - rz) >> ROOM_BUCKET_SHIFT, 0, (info->zSectors - 1) >> 1);
+
+    if (flat)
+    {
+        minX = maxX = minZ = maxZ = 0;
+    }
+
+    for (int32 bx = minX; bx <= maxX; bx++)
+    {
+        for (int32 bz = minZ; bz <= maxZ; bz++)
+        {
+            Item* item = buckets[bx * zBuckets + bz];
+
+            while (item && list - itemsList < MAX_ITEM_LIST - 1)
+            {
+                *list++ = item;
+                item = item->nextBucket;
+            }
+        }
+    }
+
+    return list;
+}
 
 void checkTrigger(const FloorData* fd, Item* lara)
 {
@@ -769,7 +850,7 @@ void checkTrigger(const FloorData* fd, Item* lara)
                     break;
 
                 gSaveGame.secrets |= (1 << triggerCmd.args);
-                mixer.playMusic(TRACK_13_WAV); // TODO play sample?
+                musicPlay(13); // TODO play sample?
                 break;
             }
 
@@ -32,8 +32,8 @@ struct Mixer
 
     struct Music
     {
-        const uint8*  data;
-        int32         size;
+        const uint32* data; // IMA ADPCM nibbles, low first, 8 samples per word
+        int32         size; // in words
         int32         pos;
         int32         smp;
         int32         idx;
@@ -58,7 +58,9 @@ struct Mixer
 
         X_INLINE void fill(int32* buffer, int32 count)
         {
-            for (int32 i = 0; i < count; i += 2)
+            ASSERT((count & 7) == 0);
+
+            for (int32 i = 0; i < count; i += 8)
             {
                 if (pos >= size)
                 {
@@ -68,8 +70,15 @@ struct Mixer
                 }
 
                 uint32 n = data[pos++];
-                *buffer++ = getSample(n);
-                *buffer++ = getSample(n >> 4);
+                buffer[0] = getSample(n);
+                buffer[1] = getSample(n >> 4);
+                buffer[2] = getSample(n >> 8);
+                buffer[3] = getSample(n >> 12);
+                buffer[4] = getSample(n >> 16);
+                buffer[5] = getSample(n >> 20);
+                buffer[6] = getSample(n >> 24);
+                buffer[7] = getSample(n >> 28);
+                buffer += 8;
             }
         }
     };
@@ -84,17 +93,23 @@ struct Mixer
 
         X_INLINE void fill(int32* buffer, int32 count)
         {
+            ASSERT(inc > 0);
+
+            int32 left = (size - pos + inc - 1) / inc; // samples before the end
+            if (count > left) {
+                count = left;
+            }
+
             for (int32 i = 0; i < count; i++)
             {
                 buffer[i] += SND_DECODE(data[pos >> SND_FIXED_SHIFT]) * volume;
-
                 pos += inc;
-                if (pos >= size)
-                {
-                    // TODO LOOP
-                    data = NULL;
-                    return;
-                }
+            }
+
+            if (pos >= size)
+            {
+                // TODO LOOP
+                data = NULL;
             }
         }
     };
@@ -103,55 +118,7 @@ struct Mixer
     Sample channels[SND_CHANNELS];
     int32  channelsCount;
 
-    void fill(uint8* bufferA, uint8* bufferB, int32 count)
-    {
-        UNUSED(bufferB);
-
-        if ((channelsCount == 0) && !music.data)
-        {
-            dmaFill(bufferA, SND_ENCODE(0), count);
-        #ifdef USE_9BIT_SOUND
-            dmaFill(bufferB, SND_ENCODE(0), count);
-        #endif
-            return;
-        }
-
-        int32 tmp[SND_SAMPLES];
-
-        if (music.data) {
-            music.fill(tmp, count);
-        } else {
-            dmaFill(tmp, 0, sizeof(tmp));
-        }
-
-        int32 ch = channelsCount;
-        while (ch--)
-        {
-            Sample* sample = channels + ch;
-
-            sample->fill(tmp, count);
-
-            if (!sample->data) {
-                channels[ch] = channels[--channelsCount];
-            }
-        }
-
-        for (int32 i = 0; i < count; i++)
-        {
-            int32 samp = X_CLAMP(tmp[i] >> SND_VOL_SHIFT, SND_MIN, SND_MAX);
-
-        #if defined(_WIN32)
-            bufferA[i] = SND_ENCODE(samp);
-        #elif defined(__GBA__)
-            #ifdef USE_9BIT_SOUND
-                bufferA[i] = (samp >> 1);
-                bufferB[i] = (samp >> 1) + (samp & 1); // TODO
-            #else
-                bufferA[i] = samp;
-            #endif
-        #endif
-        }
-    }
+    void fill(uint8* bufferA, uint8* bufferB, int32 count);
 
     #define CALC_INC (((SND_SAMPLE_FREQ << SND_FIXED_SHIFT) / SND_OUTPUT_FREQ) * pitch >> SND_PITCH_SHIFT)
 
@@ -199,8 +166,8 @@ struct Mixer
 
     void playMusic(const void* data)
     {
-        music.data   = (uint8*)data + 16;
-        music.size   = *((int32*)data + 2);
+        music.data   = (uint32*)data + 4;
+        music.size   = *((int32*)data + 2) >> 2;
         music.pos    = 0;
         //music.volume = (1 << SND_VOL_SHIFT);
         music.smp    = 0;
@@ -216,4 +183,55 @@ struct Mixer
 
 Mixer mixer;
 
+// called from the sound interrupt, ARM code in IWRAM on GBA
+ARM_CODE IWRAM_CODE void Mixer::fill(uint8* bufferA, uint8* bufferB, int32 count)
+{
+    UNUSED(bufferB);
+
+    if ((channelsCount == 0) && !music.data)
+    {
+        dmaFill(bufferA, SND_ENCODE(0), count);
+    #ifdef USE_9BIT_SOUND
+        dmaFill(bufferB, SND_ENCODE(0), count);
+    #endif
+        return;
+    }
+
+    int32 tmp[SND_SAMPLES];
+
+    if (music.data) {
+        music.fill(tmp, count);
+    } else {
+        dmaFill(tmp, 0, sizeof(tmp));
+    }
+
+    int32 ch = channelsCount;
+    while (ch--)
+    {
+        Sample* sample = channels + ch;
+
+        sample->fill(tmp, count);
+
+        if (!sample->data) {
+            channels[ch] = channels[--channelsCount];
+        }
+    }
+
+    for (int32 i = 0; i < count; i++)
+    {
+        int32 samp = X_CLAMP(tmp[i] >> SND_VOL_SHIFT, SND_MIN, SND_MAX);
+
+    #if defined(_WIN32) || defined(__linux__)
+        bufferA[i] = SND_ENCODE(samp);
+    #elif defined(__GBA__)
+        #ifdef USE_9BIT_SOUND
+            bufferA[i] = (samp >> 1);
+            bufferB[i] = (samp >> 1) + (samp & 1); // TODO
+        #else
+            bufferA[i] = samp;
+        #endif
+    #endif
+    }
+}
+
 #endif
@@ -46,6 +46,51 @@ void osMutexUnlock(void *obj) {
     LeaveCriticalSection((CRITICAL_SECTION*)obj);
 }
 
+struct ThreadParams {
+    void (*proc)(void *arg);
+    void *arg;
+};
+
+DWORD WINAPI osThreadProc(void *arg) {
+    ThreadParams params = *(ThreadParams*)arg;
+    delete (ThreadParams*)arg;
+    params.proc(params.arg);
+    return 0;
+}
+
+void* osThreadCreate(void (*proc)(void *arg), void *arg) {
+    ThreadParams *params = new ThreadParams();
+    params->proc = proc;
+    params->arg  = arg;
+
+    HANDLE thread = CreateThread(NULL, 0, osThreadProc, params, 0, NULL);
+    if (!thread) {
+        delete params;
+    }
+    return thread;
+}
+
+void osThreadJoin(void *obj) {
+    WaitForSingleObject((HANDLE)obj, INFINITE);
+    CloseHandle((HANDLE)obj);
+}
+
+void* osSemaInit(int count) {
+    return CreateSemaphore(NULL, count, 0x7FFFFFFF, NULL);
+}
+
+void osSemaFree(void *obj) {
+    CloseHandle((HANDLE)obj);
+}
+
+void osSemaWait(void *obj) {
+    WaitForSingleObject((HANDLE)obj, INFINITE);
+}
+
+void osSemaPost(void *obj) {
+    ReleaseSemaphore((HANDLE)obj, 1, NULL);
+}
+
 // timing
 int osStartTime = 0;
 
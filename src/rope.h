@@ -0,0 +1,249 @@
+#ifndef H_ROPE
+#define H_ROPE
+
+#include "utils.h"
+
+#define ROPE_MAX_ROPES      16
+#define ROPE_MAX_PARTICLES  256
+#define ROPE_MAX_SPHERES    64
+#define ROPE_TIMESTEP       (1.0f / 60.0f)
+#define ROPE_MAX_SUBSTEPS   4
+#define ROPE_ITERATIONS     4
+#define ROPE_SPHERE_PUSH    0.9f
+
+// verlet chains with a pinned first particle
+// particles of all ropes are stored together and stepped at a fixed rate in one pass per tick
+struct RopeSystem {
+
+    struct Rope {
+        int   first, count;             // particles range
+        int   sphereFirst, sphereCount; // colliders of the current tick
+        vec3  anchor, anchorPrev;
+        float gravity;                  // units per second^2
+        float damping;
+        float speedLimit;               // units per second
+        float floor;
+        float waterLevel;               // particles below it float up
+        bool  water;
+        bool  active;
+    } ropes[ROPE_MAX_ROPES];
+
+    float  px[ROPE_MAX_PARTICLES], py[ROPE_MAX_PARTICLES], pz[ROPE_MAX_PARTICLES];
+    float  ox[ROPE_MAX_PARTICLES], oy[ROPE_MAX_PARTICLES], oz[ROPE_MAX_PARTICLES];
+    float  length[ROPE_MAX_PARTICLES]; // rest length to the next particle
+    int    count;
+
+    Sphere spheres[ROPE_MAX_SPHERES];
+    int    spheresCount;
+
+    float  timer;
+
+    struct Stats {
+        int ropes, particles, substeps, constraints;
+    } stats;
+
+    RopeSystem() : count(0), spheresCount(0), timer(0.0f) {
+        for (int i = 0; i < ROPE_MAX_ROPES; i++)
+            ropes[i] = Rope();
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    int add(int particles, const vec3 *pos, const float *lengths) {
+        if (count + particles > ROPE_MAX_PARTICLES)
+            return -1;
+
+        for (int i = 0; i < ROPE_MAX_ROPES; i++) {
+            Rope &r = ropes[i];
+            if (r.active) continue;
+
+            r = Rope();
+            r.first      = count;
+            r.count      = particles;
+            r.anchor     = r.anchorPrev = pos[0];
+            r.damping    = 1.0f;
+            r.speedLimit = 1024.0f * 1024.0f;
+            r.floor      = 1024.0f * 1024.0f;
+            r.active     = true;
+
+            for (int j = 0; j < particles; j++) {
+                px[count + j] = ox[count + j] = pos[j].x;
+                py[count + j] = oy[count + j] = pos[j].y;
+                pz[count + j] = oz[count + j] = pos[j].z;
+                length[count + j] = lengths[j];
+            }
+            count += particles;
+            return i;
+        }
+        return -1;
+    }
+
+    void remove(int index) {
+        if (index < 0) return;
+        Rope &r = ropes[index];
+        ASSERT(r.active);
+
+        int tail = count - (r.first + r.count);
+        if (tail) {
+            memmove(px + r.first, px + r.first + r.count, tail * sizeof(float));
+            memmove(py + r.first, py + r.first + r.count, tail * sizeof(float));
+            memmove(pz + r.first, pz + r.first + r.count, tail * sizeof(float));
+            memmove(ox + r.first, ox + r.first + r.count, tail * sizeof(float));
+            memmove(oy + r.first, oy + r.first + r.count, tail * sizeof(float));
+            memmove(oz + r.first, oz + r.first + r.count, tail * sizeof(float));
+            memmove(length + r.first, length + r.first + r.count, tail * sizeof(float));
+        }
+
+        for (int i = 0; i < ROPE_MAX_ROPES; i++)
+            if (ropes[i].active && ropes[i].first > r.first)
+                ropes[i].first -= r.count;
+
+        count -= r.count;
+        r.active = false;
+    }
+
+    vec3 getPos(int index, int i) const {
+        int j = ropes[index].first + i;
+        return vec3(px[j], py[j], pz[j]);
+    }
+
+    void setAnchor(int index, const vec3 &pos) {
+        ropes[index].anchor = pos;
+    }
+
+    // colliders for the next update, replaces the previous set of the rope
+    void setSpheres(int index, const Sphere *list, int listCount) {
+        Rope &r = ropes[index];
+        if (r.sphereCount && r.sphereFirst + r.sphereCount == spheresCount)
+            spheresCount = r.sphereFirst;
+
+        listCount = min(listCount, ROPE_MAX_SPHERES - spheresCount);
+        memcpy(spheres + spheresCount, list, listCount * sizeof(Sphere));
+        r.sphereFirst  = spheresCount;
+        r.sphereCount  = listCount;
+        spheresCount  += listCount;
+    }
+
+    void integrate(const Rope &r, float dt) {
+        float accel   = r.gravity * dt * dt;
+        float damping = 1.0f / (1.0f + r.damping * dt); // Pade approximation
+        float limit   = r.speedLimit * dt;
+
+        for (int i = r.first + 1; i < r.first + r.count; i++) {
+            float dx = px[i] - ox[i];
+            float dy = py[i] - oy[i];
+            float dz = pz[i] - oz[i];
+
+            float len2 = dx * dx + dy * dy + dz * dz;
+            float k = (len2 > limit * limit) ? (limit / sqrtf(len2)) * damping : damping; // speed limit
+
+            ox[i] = px[i];
+            oy[i] = py[i];
+            oz[i] = pz[i];
+            px[i] += dx * k;
+            py[i] += dy * k + ((r.water && py[i] > r.waterLevel) ? -accel : accel);
+            pz[i] += dz * k;
+        }
+    }
+
+    void collide(const Rope &r) {
+        for (int i = r.first + 1; i < r.first + r.count; i++)
+            py[i] = min(py[i], r.floor);
+
+        for (int s = r.sphereFirst; s < r.sphereFirst + r.sphereCount; s++) {
+            const Sphere &sphere = spheres[s];
+            float radiusSq = sphere.radius * sphere.radius;
+
+            for (int i = r.first + 1; i < r.first + r.count; i++) {
+                float dx = px[i] - sphere.center.x;
+                float dy = py[i] - sphere.center.y;
+                float dz = pz[i] - sphere.center.z;
+                float len = dx * dx + dy * dy + dz * dz + EPS;
+                if (len < radiusSq) {
+                    len = sqrtf(len);
+                    float k = (sphere.radius - len) / len * ROPE_SPHERE_PUSH;
+                    px[i] += dx * k;
+                    py[i] += dy * k;
+                    pz[i] += dz * k;
+                }
+            }
+        }
+    }
+
+    void solve(const Rope &r) {
+        int last = r.first + r.count - 1;
+        for (int i = r.first; i < last; i++) {
+            float dx = px[i + 1] - px[i];
+            float dy = py[i + 1] - py[i];
+            float dz = pz[i + 1] - pz[i];
+
+            float len = sqrtf(dx * dx + dy * dy + dz * dz) + EPS;
+            float d   = (length[i] - len) / len;
+
+            if (i > r.first) {
+                d *= 0.5f;
+                px[i] -= dx * d;
+                py[i] -= dy * d;
+                pz[i] -= dz * d;
+            }
+            px[i + 1] += dx * d;
+            py[i + 1] += dy * d;
+            pz[i + 1] += dz * d;
+        }
+    }
+
+    void update(float deltaTime) {
+        memset(&stats, 0, sizeof(stats));
+
+        timer += deltaTime;
+        int steps = int(timer / ROPE_TIMESTEP);
+        timer -= steps * ROPE_TIMESTEP;
+        if (steps > ROPE_MAX_SUBSTEPS) {
+            steps = ROPE_MAX_SUBSTEPS;
+            timer = 0.0f;
+        }
+
+        for (int s = 0; s < steps; s++) {
+            float t = float(s + 1) / steps;
+
+            for (int i = 0; i < ROPE_MAX_ROPES; i++) {
+                Rope &r = ropes[i];
+                if (!r.active) continue;
+
+                vec3 anchor = r.anchorPrev.lerp(r.anchor, t);
+                px[r.first] = anchor.x;
+                py[r.first] = anchor.y;
+                pz[r.first] = anchor.z;
+
+                integrate(r, ROPE_TIMESTEP);
+                collide(r);
+            }
+
+            for (int k = 0; k < ROPE_ITERATIONS; k++)
+                for (int i = 0; i < ROPE_MAX_ROPES; i++)
+                    if (ropes[i].active)
+                        solve(ropes[i]);
+        }
+
+        for (int i = 0; i < ROPE_MAX_ROPES; i++) {
+            Rope &r = ropes[i];
+            if (!r.active) continue;
+
+            px[r.first] = ox[r.first] = r.anchor.x;
+            py[r.first] = oy[r.first] = r.anchor.y;
+            pz[r.first] = oz[r.first] = r.anchor.z;
+            r.anchorPrev  = r.anchor;
+            r.sphereCount = 0;
+
+            stats.ropes++;
+            stats.constraints += (r.count - 1) * ROPE_ITERATIONS * steps;
+        }
+        stats.particles = count;
+        stats.substeps  = steps;
+
+        spheresCount = 0;
+    }
+};
+
+RopeSystem ropeSystem;
+
+#endif
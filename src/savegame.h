@@ -6,6 +6,8 @@
 #define MAX_FLIPMAP_COUNT     32
 #define MAX_TRACKS_COUNT      256
 
+//#define REWIND // keep the world snapshots for the ik7 rewind
+
 #define SAVE_FILENAME       "savegame.dat"
 #define SAVE_MAGIC          FOURCC("OLS2")
 
@@ -115,6 +117,233 @@ SaveResult      saveResult;
 int             loadSlot;
 SaveStats       saveStats;
 
+#ifdef REWIND
+// ring of world snapshots (checkpoint save data) in a fixed arena
+// every frame is XOR'ed against the previous one and zero runs are skipped, a key frame starts every REWIND_KEY_PERIOD frames
+#define REWIND_ARENA_SIZE   (4 * 1024 * 1024)
+#define REWIND_MAX_FRAMES   1024
+#define REWIND_KEY_PERIOD   32
+#define REWIND_PERIOD       6       // ticks between snapshots
+#define REWIND_MIN_ZEROS    4       // shorter zero runs are stored as literals
+
+struct Rewind {
+    struct Frame {
+        int32 offset;
+        int32 size;
+        int32 rawSize;
+        bool  key;
+    };
+
+    uint8  *arena;
+    uint8  *prev;       // raw data of the newest frame
+    uint8  *encoded;
+    int32  rawCapacity;
+    int32  prevSize;
+    int32  writePos;
+
+    Frame  frames[REWIND_MAX_FRAMES];
+    int32  first, count;
+    int32  sinceKey;
+    int32  tick;
+
+    struct Stats {
+        int32 frameSize;
+        int32 time, timeCount; // accumulated capture time in ms
+        float timeAvg;
+    } stats;
+
+    Rewind() : arena(NULL), prev(NULL), encoded(NULL), rawCapacity(0) {}
+
+    ~Rewind() {
+        free();
+    }
+
+    void init(int32 rawSize) {
+        if (!arena)
+            arena = new uint8[REWIND_ARENA_SIZE];
+        if (rawSize > rawCapacity) {
+            delete[] prev;
+            delete[] encoded;
+            rawCapacity = rawSize;
+            prev    = new uint8[rawCapacity];
+            encoded = new uint8[getEncodedSize(rawCapacity)];
+        }
+        reset();
+    }
+
+    void free() {
+        delete[] arena;
+        delete[] prev;
+        delete[] encoded;
+        arena = prev = encoded = NULL;
+        rawCapacity = 0;
+    }
+
+    void reset() {
+        first = count = 0;
+        writePos = 0;
+        prevSize = 0;
+        sinceKey = 0;
+        tick     = 0;
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    int32 getUsed() const {
+        int32 used = 0;
+        for (int i = 0; i < count; i++)
+            used += frames[(first + i) % REWIND_MAX_FRAMES].size;
+        return used;
+    }
+
+    static int32 getEncodedSize(int32 rawSize) {
+        return rawSize + 8 + 4 * (rawSize / 0xFFFF + 1);
+    }
+
+    // tokens: uint16 zeros, uint16 literals, literal bytes
+    static int32 encode(uint8 *dst, const uint8 *src, int32 size, const uint8 *base, int32 baseSize) {
+        uint8 *ptr = dst;
+        int32 i = 0;
+        while (i < size) {
+            int32 zeros = 0;
+            while (i + zeros < size && zeros < 0xFFFF && src[i + zeros] == (i + zeros < baseSize ? base[i + zeros] : 0))
+                zeros++;
+            i += zeros;
+
+            int32 start = i, run = 0;
+            while (i < size && i - start < 0xFFFF - REWIND_MIN_ZEROS) {
+                uint8 b = src[i] ^ (i < baseSize ? base[i] : 0);
+                run = b ? 0 : run + 1;
+                i++;
+                if (run == REWIND_MIN_ZEROS) {
+                    i -= run;
+                    break;
+                }
+            }
+            uint16 literals = uint16(i - start);
+
+            *(uint16*)ptr = uint16(zeros);
+            *(uint16*)(ptr + 2) = literals;
+            ptr += 4;
+            for (int j = start; j < i; j++)
+                *ptr++ = src[j] ^ (j < baseSize ? base[j] : 0);
+        }
+        return int32(ptr - dst);
+    }
+
+    // dst holds the previous frame data (or zeros for a key frame)
+    static void decode(uint8 *dst, int32 dstSize, const uint8 *src, int32 srcSize) {
+        const uint8 *end = src + srcSize;
+        int32 i = 0;
+        while (src < end) {
+            i += *(uint16*)src;
+            int32 literals = *(uint16*)(src + 2);
+            src += 4;
+            ASSERT(i + literals <= dstSize);
+            while (literals--)
+                dst[i++] ^= *src++;
+        }
+    }
+
+    void evict() {
+        ASSERT(count > 0);
+    // drop the deltas that depended on it as well
+        do {
+            first = (first + 1) % REWIND_MAX_FRAMES;
+            count--;
+        } while (count && !frames[first].key);
+    }
+
+    bool overlaps(int32 offset, int32 size) const {
+        if (!count) return false;
+        const Frame &f = frames[first];
+        return f.offset < offset + size && offset < f.offset + f.size;
+    }
+
+    void push(const uint8 *data, int32 size) {
+        ASSERT(arena && size <= rawCapacity);
+
+        bool key = !count || sinceKey >= REWIND_KEY_PERIOD;
+        int32 encSize = encode(encoded, data, size, prev, key ? 0 : prevSize);
+
+        if (encSize > REWIND_ARENA_SIZE)
+            return;
+
+        if (writePos + encSize > REWIND_ARENA_SIZE) { // the tail of the arena holds the oldest frames
+            while (count && frames[first].offset >= writePos)
+                evict();
+            writePos = 0;
+        }
+
+        while (count == REWIND_MAX_FRAMES || overlaps(writePos, encSize))
+            evict();
+
+        if (!count && !key) { // the key frame was evicted, start over
+            push(data, size);
+            return;
+        }
+
+        Frame &f = frames[(first + count) % REWIND_MAX_FRAMES];
+        f.offset  = writePos;
+        f.size    = encSize;
+        f.rawSize = size;
+        f.key     = key;
+        memcpy(arena + writePos, encoded, encSize);
+        writePos += encSize;
+        count++;
+
+        sinceKey = key ? 1 : sinceKey + 1;
+
+        memcpy(prev, data, size);
+        prevSize = size;
+        stats.frameSize = encSize;
+    }
+
+    void addTime(int32 time) {
+        stats.time += time;
+        if (++stats.timeCount == REWIND_KEY_PERIOD) {
+            stats.timeAvg   = float(stats.time) / stats.timeCount;
+            stats.time      = 0;
+            stats.timeCount = 0;
+        }
+    }
+
+    // returns the raw size of the frame (0 = the oldest retained)
+    int32 get(int32 index, uint8 *data) const {
+        ASSERT(index >= 0 && index < count);
+
+        int32 start = index;
+        while (!frames[(first + start) % REWIND_MAX_FRAMES].key)
+            start--;
+
+        memset(data, 0, rawCapacity);
+        for (int i = start; i <= index; i++) {
+            const Frame &f = frames[(first + i) % REWIND_MAX_FRAMES];
+            decode(data, f.rawSize, arena + f.offset, f.size);
+            memset(data + f.rawSize, 0, rawCapacity - f.rawSize); // the encoder treats missing bytes as zeros
+        }
+        return frames[(first + index) % REWIND_MAX_FRAMES].rawSize;
+    }
+
+    // drop the frames after index and continue recording from it
+    void truncate(int32 index) {
+        ASSERT(index >= 0 && index < count);
+        count = index + 1;
+
+        const Frame &f = frames[(first + index) % REWIND_MAX_FRAMES];
+        writePos = f.offset + f.size;
+
+        sinceKey = 0;
+        for (int i = index; i >= 0 && !frames[(first + i) % REWIND_MAX_FRAMES].key; i--)
+            sinceKey++;
+        sinceKey++;
+
+        prevSize = get(index, prev);
+    }
+};
+
+Rewind saveRewind;
+#endif
+
 void freeSaveSlots() {
     for (int i = 0; i < saveSlots.length; i++)
         delete[] saveSlots[i].data;
@@ -49,8 +49,18 @@ varying vec4 vDiffuse;
 
 	uniform sampler2D sDiffuse;
 
+	#ifdef OPT_PALETTE
+		uniform sampler2D sPalette;
+
+		vec4 fetchDiffuse(vec2 uv) { // 8-bit index to the palette colour
+			return texture2D(sPalette, vec2(texture2D(sDiffuse, uv).x * (255.0 / 256.0) + (0.5 / 256.0), 0.5));
+		}
+	#else
+		#define fetchDiffuse(uv) texture2D(sDiffuse, uv)
+	#endif
+
 	void main() {
-		vec4 color = texture2D(sDiffuse, vTexCoord);
+		vec4 color = fetchDiffuse(vTexCoord);
 
 		#ifdef ALPHA_TEST
 			if (color.w <= 0.5)
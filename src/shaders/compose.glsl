@@ -253,6 +253,16 @@ varying vec4 vTexCoord; // xy - atlas coords, zw - trapezoidal correction
 		uniform samplerCube sDiffuse;
 	#else
 		uniform sampler2D sDiffuse;
+
+		#ifdef OPT_PALETTE
+			uniform sampler2D sPalette;
+
+			vec4 fetchDiffuse(vec2 uv) { // 8-bit index to the palette colour
+				return texture2D(sPalette, vec2(texture2D(sDiffuse, uv).x * (255.0 / 256.0) + (0.5 / 256.0), 0.5));
+			}
+		#else
+			#define fetchDiffuse(uv) texture2D(sDiffuse, uv)
+		#endif
 	#endif
 
 	float unpack(vec4 value) {
@@ -361,7 +371,7 @@ varying vec4 vTexCoord; // xy - atlas coords, zw - trapezoidal correction
 					uv /= vTexCoord.zw;
 				#endif
 			#endif
-			color = texture2D(sDiffuse, uv);
+			color = fetchDiffuse(uv);
 		#endif
 
 		#ifdef ALPHA_TEST
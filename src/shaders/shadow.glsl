@@ -41,6 +41,16 @@ R"====(
 	
 	#ifdef ALPHA_TEST
 		uniform sampler2D sDiffuse;
+
+		#ifdef OPT_PALETTE
+			uniform sampler2D sPalette;
+
+			vec4 fetchDiffuse(vec2 uv) { // 8-bit index to the palette colour
+				return texture2D(sPalette, vec2(texture2D(sDiffuse, uv).x * (255.0 / 256.0) + (0.5 / 256.0), 0.5));
+			}
+		#else
+			#define fetchDiffuse(uv) texture2D(sDiffuse, uv)
+		#endif
 	#endif
 
 	vec4 pack(float value) {
@@ -50,7 +60,7 @@ R"====(
 
 	void main() {
 		#ifdef ALPHA_TEST
-			if (texture2D(sDiffuse, vTexCoord).w <= 0.5)
+			if (fetchDiffuse(vTexCoord).w <= 0.5)
 				discard;
 		#endif
 
@@ -22,6 +22,16 @@ uniform vec4 uViewPos;
 #else
 	uniform sampler2D sDiffuse;
 
+	#ifdef OPT_PALETTE
+		uniform sampler2D sPalette;
+
+		vec4 fetchDiffuse(vec2 uv) { // 8-bit index to the palette colour
+			return texture2D(sPalette, vec2(texture2D(sDiffuse, uv).x * (255.0 / 256.0) + (0.5 / 256.0), 0.5));
+		}
+	#else
+		#define fetchDiffuse(uv) texture2D(sDiffuse, uv)
+	#endif
+
 	#ifdef SKY_CLOUDS_AZURE
 		#define SKY_CLOUDS
 		#define SKY_AZURE
@@ -102,7 +112,7 @@ uniform vec4 uViewPos;
 		#ifdef SKY_AZURE
 			vec3 col = mix(skyDown, skyUp, dir.y);
 		#else
-			vec3 col = texture2D(sDiffuse, vTexCoord).xyz * vColor.xyz;
+			vec3 col = fetchDiffuse(vTexCoord).xyz * vColor.xyz;
 		#endif
 
 		#ifdef SKY_CLOUDS
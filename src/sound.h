@@ -872,6 +872,7 @@ namespace Sound {
         float   pitch;
         int     flags;
         int     id;
+        int     framesDecoded;
         bool    isPlaying;
         bool    isPaused;
         bool    stopAfterFade;
@@ -881,11 +882,13 @@ namespace Sound {
             isPlaying = decoder != NULL;
             isPaused  = false;
             stopAfterFade = true;
+            framesDecoded = 0;
         }
 
         Sample(Stream *stream, const vec3 *pos, float volume, float pitch, int flags, int id) : uniquePtr(pos), decoder(NULL), volume(volume), volumeTarget(volume), volumeDelta(0.0f), pitch(pitch), flags(flags), id(id)
         {
             this->pos = pos ? *pos : vec3(0.0f);
+            framesDecoded = 0;
 
         #ifndef NO_SOUND
             uint32 fourcc;
@@ -1016,6 +1019,7 @@ namespace Sound {
 
                 i += ret;
             }
+            framesDecoded += i;
 
         // apply volume
             #define VOL_CONV(x) (1.0f - sqrtf(1.0f - x * x));
@@ -100,6 +100,10 @@ struct Texture : GAPI::Texture {
             filter = false;
         }
 
+        if (format == FMT_INDEX) {
+            filter = false;
+        }
+
         if (format == FMT_RG_HALF) {
             if (Core::support.texHalf)
                 filter = filter && Core::support.texHalfLinear;
@@ -695,13 +699,12 @@ struct Texture : GAPI::Texture {
     }
 
 
-    static Texture* Load(Stream &stream, bool border = true) {
-        uint32 width, height;
+    static uint8* Decode(Stream &stream, uint32 &width, uint32 &height, uint32 &dw, uint32 &dh, bool border) {
         uint8 *data = LoadDATA(stream, width, height);
 
     // convert to POT size if NPOT isn't supported
-        uint32 dw = Core::support.texNPOT ? width  : nextPow2(width);
-        uint32 dh = Core::support.texNPOT ? height : nextPow2(height);
+        dw = Core::support.texNPOT ? width  : nextPow2(width);
+        dh = Core::support.texNPOT ? height : nextPow2(height);
         if (dw != width || dh != height) {
             uint32 *dataPOT = new uint32[dw * dh];
             uint32 *dst = (uint32*)dataPOT;
@@ -720,6 +723,13 @@ struct Texture : GAPI::Texture {
                 ((uint32*)data)[y * dw] = ((uint32*)data)[y * dw + dw - 1] = 0xFF000000;
         }
 
+        return data;
+    }
+
+    static Texture* Load(Stream &stream, bool border = true) {
+        uint32 width, height, dw, dh;
+        uint8 *data = Decode(stream, width, height, dw, dh, border);
+
         Texture *tex = new Texture(dw, dh, 1, FMT_RGBA, 0, data);
         tex->origWidth  = width;
         tex->origHeight = height;
@@ -728,179 +738,1026 @@ struct Texture : GAPI::Texture {
 
         return tex;
     }
+
+// async loading, image is decoded by Core::worker, GPU upload is done on the main thread (by slices for GL)
+    #define TEX_UPLOAD_SLICE (512 * 1024)
+
+    struct LoadJob {
+        typedef void (Callback)(Texture *tex, void *userData);
+
+        Stream   *stream;
+        uint8    *data;
+        uint32   width, height, dw, dh;
+        uint32   row;
+        bool     border;
+        Texture  *tex;
+        Callback *callback;
+        void     *userData;
+
+        void cancel() {
+            callback = NULL;
+        }
+    };
+
+    static void loadJobProcess(void *userData) {
+        LoadJob *job = (LoadJob*)userData;
+        job->data = Decode(*job->stream, job->width, job->height, job->dw, job->dh, job->border);
+        delete job->stream;
+        job->stream = NULL;
+    }
+
+    static void loadJobComplete(void *userData) {
+        LoadJob *job = (LoadJob*)userData;
+
+        if (job->callback) {
+            if (!job->tex) {
+            #ifdef _GAPI_GL
+                bool sliced = job->dw * job->dh * 4 > TEX_UPLOAD_SLICE;
+            #else
+                bool sliced = false;
+            #endif
+                job->tex = new Texture(job->dw, job->dh, 1, FMT_RGBA, 0, sliced ? NULL : job->data);
+                job->tex->origWidth  = job->width;
+                job->tex->origHeight = job->height;
+                job->row = sliced ? 0 : job->dh;
+            }
+
+        #ifdef _GAPI_GL
+            if (job->row < job->dh) {
+                uint32 count = min(max(TEX_UPLOAD_SLICE / (job->dw * 4), 1U), job->dh - job->row);
+                job->tex->updateRows(job->data, job->row, count);
+                job->row += count;
+
+                if (job->row < job->dh) {
+                    Core::worker.add(NULL, loadJobComplete, job); // upload the next slice on the next frame
+                    return;
+                }
+            }
+        #endif
+
+            job->callback(job->tex, job->userData);
+        } else {
+            delete job->tex;
+        }
+
+        delete[] job->data;
+        delete job;
+    }
+
+    static LoadJob* LoadAsync(Stream *stream, LoadJob::Callback *callback, void *userData, bool border = true) {
+        LoadJob *job  = new LoadJob();
+        job->stream   = stream;
+        job->data     = NULL;
+        job->border   = border;
+        job->row      = 0;
+        job->tex      = NULL;
+        job->callback = callback;
+        job->userData = userData;
+
+        Core::worker.add(loadJobProcess, loadJobComplete, job);
+        return job;
+    }
 };
 
 
-struct Atlas {
+#ifdef USE_ATLAS_COMPRESSION
+// block encoders for the level atlases, premultiplied RGBA8 source with the mip chain built on the CPU
+namespace TexCompress {
+
+    static const int8 EAC_TABLE[16][8] = {
+        { -3, -6,  -9, -15, 2, 5, 8, 14 },
+        { -3, -7, -10, -13, 2, 6, 9, 12 },
+        { -2, -5,  -8, -13, 1, 4, 7, 12 },
+        { -2, -4,  -6, -13, 1, 3, 5, 12 },
+        { -3, -6,  -8, -12, 2, 5, 7, 11 },
+        { -3, -7,  -9, -11, 2, 6, 8, 10 },
+        { -4, -7,  -8, -11, 3, 6, 7, 10 },
+        { -3, -5,  -8, -11, 2, 4, 7, 10 },
+        { -2, -6,  -8, -10, 1, 5, 7,  9 },
+        { -2, -5,  -8, -10, 1, 4, 7,  9 },
+        { -2, -4,  -8, -10, 1, 3, 7,  9 },
+        { -2, -5,  -7, -10, 1, 4, 6,  9 },
+        { -3, -4,  -7, -10, 2, 3, 6,  9 },
+        { -1, -2,  -3, -10, 0, 1, 2,  9 },
+        { -4, -6,  -8,  -9, 3, 5, 7,  8 },
+        { -3, -5,  -7,  -9, 2, 4, 6,  8 },
+    };
 
-    struct Tile {
-        uint16          id;
-        TR::TextureInfo *tex;
-        short4          uv;
-    } *tiles;
+    static const int16 ETC_TABLE[8][4] = { // pixel index 0..3 -> a, b, -a, -b
+        {  2,   8,  -2,   -8 },
+        {  5,  17,  -5,  -17 },
+        {  9,  29,  -9,  -29 },
+        { 13,  42, -13,  -42 },
+        { 18,  60, -18,  -60 },
+        { 24,  80, -24,  -80 },
+        { 33, 106, -33, -106 },
+        { 47, 183, -47, -183 },
+    };
 
-    typedef void (Callback)(Atlas *atlas, int id, int tileX, int tileY, int atalsWidth, int atlasHeight, Tile &tile, void *userData, void *data);
+    inline int colorDist(const Color32 &a, int r, int g, int b) {
+        return SQR(a.r - r) + SQR(a.g - g) + SQR(a.b - b);
+    }
+
+    inline uint16 pack565(int r, int g, int b) {
+        return uint16((((r * 31 + 127) / 255) << 11) | (((g * 63 + 127) / 255) << 5) | ((b * 31 + 127) / 255));
+    }
+
+    inline Color32 unpack565(uint16 c) {
+        int r = (c >> 11) & 31;
+        int g = (c >> 5)  & 63;
+        int b = c & 31;
+        return Color32((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2), 255);
+    }
+
+    void getBlock(const Color32 *data, int width, int height, int bx, int by, Color32 *block) {
+        for (int y = 0; y < 4; y++)
+            for (int x = 0; x < 4; x++)
+                block[y * 4 + x] = data[min(by + y, height - 1) * width + min(bx + x, width - 1)];
+    }
 
-    struct Node {
-        Node   *child[2];
-        short4 rect;
-        int    tileIndex;
+// BC1 / BC3 palette of the endpoints and the nearest entry per texel, holes get the transparent index 3
+    int encodeIndicesBC(const Color32 *c, const bool *hole, bool transparent, uint16 &c0, uint16 &c1, uint32 &indices) {
+        bool fourColors = !transparent && c0 != c1;
 
-        Node(short l, short t, short r, short b) : rect(l, t, r, b), tileIndex(-1) { 
-            child[0] = child[1] = NULL; 
+        if (fourColors ? (c0 < c1) : (c0 > c1))
+            swap(c0, c1);
+
+        Color32 p[4];
+        p[0] = unpack565(c0);
+        p[1] = unpack565(c1);
+        if (fourColors) {
+            p[2] = Color32((p[0].r * 2 + p[1].r) / 3, (p[0].g * 2 + p[1].g) / 3, (p[0].b * 2 + p[1].b) / 3, 255);
+            p[3] = Color32((p[0].r + p[1].r * 2) / 3, (p[0].g + p[1].g * 2) / 3, (p[0].b + p[1].b * 2) / 3, 255);
+        } else {
+            p[2] = Color32((p[0].r + p[1].r) / 2, (p[0].g + p[1].g) / 2, (p[0].b + p[1].b) / 2, 255);
         }
 
-        ~Node() {
-            delete child[0];
-            delete child[1];
+        int error = 0;
+        indices = 0;
+        for (int i = 0; i < 16; i++) {
+            int index = 3;
+            if (!hole[i]) {
+                int best = 0x7FFFFFFF;
+                for (int j = 0; j < (fourColors ? 4 : 3); j++) {
+                    int d = colorDist(p[j], c[i].r, c[i].g, c[i].b);
+                    if (d < best) {
+                        best  = d;
+                        index = j;
+                    }
+                }
+                error += best;
+            }
+            indices |= index << (i * 2);
         }
+        return error;
+    }
 
-        Node* insert(Atlas *atlas, const short4 &tile, int tileIndex) {
-            ASSERT(tile.x != 0x7FFF);
+// BC1 / BC3 colour, the endpoints are the bounding box diagonal picked by the covariance with the widest channel
+// alpha 0 texels are left out of the fit and encoded as close to black as the block allows
+    void encodeColorBC(const Color32 *block, uint8 *dst, bool punchThrough) {
+        Color32 c[16];
+        bool used[16], hole[16], transparent = false, clear = false;
+        int  cmin[3] = { 255, 255, 255 }, cmax[3] = { 0, 0, 0 }, sum[3] = { 0, 0, 0 }, count = 0;
+
+        for (int i = 0; i < 16; i++) {
+            c[i] = block[i];
+            used[i] = c[i].a != 0;
+            hole[i] = false;
+
+            if (punchThrough) {
+                if (c[i].a < 128) {
+                    used[i] = false;
+                    hole[i] = transparent = true;
+                    continue;
+                }
+                if (c[i].a < 255) { // 1-bit alpha, undo the premultiplication
+                    c[i].r = min(255, c[i].r * 255 / c[i].a);
+                    c[i].g = min(255, c[i].g * 255 / c[i].a);
+                    c[i].b = min(255, c[i].b * 255 / c[i].a);
+                }
+            }
 
-            if (child[0] != NULL && child[1] != NULL) {
-                Node *node = child[0]->insert(atlas, tile, tileIndex);
-                if (node != NULL) return node;
-                return child[1]->insert(atlas, tile, tileIndex);
-            } else {
-                if (this->tileIndex != -1)
-                    return NULL;
+            if (!used[i]) {
+                c[i] = Color32(0, 0, 0, 0);
+                clear = true;
+                continue;
+            }
 
-                int16 w  = rect.z - rect.x;
-                int16 h  = rect.w - rect.y;
-                int16 tx = (tile.z - tile.x) + atlas->border.x + atlas->border.z;
-                int16 ty = (tile.w - tile.y) + atlas->border.y + atlas->border.w;
+            uint8 *v = &c[i].r;
+            for (int j = 0; j < 3; j++) {
+                cmin[j] = min(cmin[j], int(v[j]));
+                cmax[j] = max(cmax[j], int(v[j]));
+                sum[j] += v[j];
+            }
+            count++;
+        }
 
-                if (w < tx || h < ty)
-                    return NULL;
+        uint16 c0 = 0, c1 = 0;
+
+        if (count) {
+            int axis = 0;
+            for (int j = 1; j < 3; j++)
+                if (cmax[j] - cmin[j] > cmax[axis] - cmin[axis])
+                    axis = j;
+
+            int cov[3] = { 0, 0, 0 };
+            for (int i = 0; i < 16; i++) {
+                if (!used[i]) continue;
+                uint8 *v = &c[i].r;
+                int d = v[axis] * count - sum[axis];
+                for (int j = 0; j < 3; j++)
+                    cov[j] += (v[j] * count - sum[j]) * d / 256;
+            }
 
-                if (w == tx && h == ty) {
-                    this->tileIndex = tileIndex;
-                    return this;
+            int e0[3], e1[3];
+            for (int j = 0; j < 3; j++) {
+                int inset = (cmax[j] - cmin[j]) >> 4;
+                e0[j] = cmax[j] - inset;
+                e1[j] = cmin[j] + inset;
+                if (cov[j] < 0)
+                    swap(e0[j], e1[j]);
+            }
+
+            c0 = pack565(e0[0], e0[1], e0[2]);
+            c1 = pack565(e1[0], e1[1], e1[2]);
+        }
+
+        uint32 indices;
+        int error = encodeIndicesBC(c, hole, transparent, c0, c1, indices);
+
+        if (clear) { // try the brighter endpoint against black, clear texels then decode to black exactly
+            uint16 b0 = max(c0, c1), b1 = 0;
+            uint32 bi;
+            if (encodeIndicesBC(c, hole, transparent, b0, b1, bi) < error) {
+                c0      = b0;
+                c1      = b1;
+                indices = bi;
+            }
+        }
+
+        dst[0] = uint8(c0);
+        dst[1] = uint8(c0 >> 8);
+        dst[2] = uint8(c1);
+        dst[3] = uint8(c1 >> 8);
+        memcpy(dst + 4, &indices, 4);
+    }
+
+// BC3 alpha, 8 interpolated levels between the block min and max
+    void encodeAlphaBC(const Color32 *block, uint8 *dst) {
+        int a0 = 0, a1 = 255;
+        for (int i = 0; i < 16; i++) {
+            a0 = max(a0, int(block[i].a));
+            a1 = min(a1, int(block[i].a));
+        }
+
+        int p[8];
+        p[0] = a0;
+        p[1] = a1;
+        for (int i = 2; i < 8; i++)
+            p[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+
+        uint64 indices = 0;
+        if (a0 != a1) {
+            for (int i = 0; i < 16; i++) {
+                int index = 0, best = 0x7FFFFFFF;
+                for (int j = 0; j < 8; j++) {
+                    int d = abs(p[j] - block[i].a);
+                    if (d < best) {
+                        best  = d;
+                        index = j;
+                    }
                 }
+                indices |= uint64(index) << (i * 3);
+            }
+        }
 
-                int16 dx = w - tx;
-                int16 dy = h - ty;
+        dst[0] = uint8(a0);
+        dst[1] = uint8(a1);
+        for (int i = 0; i < 6; i++)
+            dst[2 + i] = uint8(indices >> (i * 8));
+    }
 
-                if (dx > dy) {
-                    child[0] = new Node(rect.x, rect.y, rect.x + tx, rect.w);
-                    child[1] = new Node(rect.x + tx, rect.y, rect.z, rect.w);
-                } else {
-                    child[0] = new Node(rect.x, rect.y, rect.z, rect.y + ty);
-                    child[1] = new Node(rect.x, rect.y + ty, rect.z, rect.w);
+// ETC2 EAC alpha, the table and multiplier are fitted to the block range
+    void encodeAlphaEAC(const Color32 *block, uint8 *dst) {
+        int amin = 255, amax = 0;
+        for (int i = 0; i < 16; i++) {
+            amin = min(amin, int(block[i].a));
+            amax = max(amax, int(block[i].a));
+        }
+
+        int bestBase = amin, bestTable = 13, bestMul = 1, bestError = 0x7FFFFFFF;
+        uint8 bestIndex[16];
+        memset(bestIndex, 4, sizeof(bestIndex)); // zero modifier of the table 13
+
+        if (amin != amax) {
+            for (int t = 0; t < 16; t++) {
+                const int8 *table = EAC_TABLE[t];
+                int span = table[7] - table[3];
+                int m = clamp((amax - amin + span / 2) / span, 1, 15);
+
+                for (int mul = max(m - 1, 1); mul <= min(m + 1, 15); mul++) {
+                    int base = clamp((amin + amax + 1) / 2 - (table[3] + table[7]) * mul / 2, 0, 255);
+                    int error = 0;
+                    uint8 index[16];
+
+                    for (int i = 0; i < 16 && error < bestError; i++) {
+                        int best = 0x7FFFFFFF;
+                        for (int j = 0; j < 8; j++) {
+                            int d = abs(clamp(base + table[j] * mul, 0, 255) - block[i].a);
+                            if (d < best) {
+                                best     = d;
+                                index[i] = j;
+                            }
+                        }
+                        error += best * best;
+                    }
+
+                    if (error < bestError) {
+                        bestError = error;
+                        bestBase  = base;
+                        bestTable = t;
+                        bestMul   = mul;
+                        memcpy(bestIndex, index, sizeof(index));
+                    }
                 }
+            }
+        }
+
+        uint64 bits = 0;
+        for (int x = 0; x < 4; x++)
+            for (int y = 0; y < 4; y++)
+                bits = (bits << 3) | bestIndex[y * 4 + x];
 
-                return child[0]->insert(atlas, tile, tileIndex);
+        dst[0] = uint8(bestBase);
+        dst[1] = uint8((bestMul << 4) | bestTable);
+        for (int i = 0; i < 6; i++)
+            dst[2 + i] = uint8(bits >> (40 - i * 8));
+    }
+
+    int encodeHalfETC(const Color32 *block, const int *pixels, const int *base, int &table, uint8 *index) {
+        int bestError = 0x7FFFFFFF;
+
+        for (int t = 0; t < 8; t++) {
+            int error = 0;
+            uint8 idx[8];
+
+            for (int i = 0; i < 8 && error < bestError; i++) {
+                const Color32 &c = block[pixels[i]];
+                int best = 0x7FFFFFFF;
+                for (int j = 0; j < 4; j++) {
+                    int m = ETC_TABLE[t][j];
+                    int d = colorDist(c, clamp(base[0] + m, 0, 255), clamp(base[1] + m, 0, 255), clamp(base[2] + m, 0, 255));
+                    if (d < best) {
+                        best   = d;
+                        idx[i] = j;
+                    }
+                }
+                error += best;
             }
+
+            if (error < bestError) {
+                bestError = error;
+                table     = t;
+                memcpy(index, idx, sizeof(idx));
+            }
+        }
+
+        return bestError;
+    }
+
+// ETC1 compatible colour (individual or differential mode, never T/H/planar), both flips are tried
+// alpha 0 texels are fitted to black, the halves are averaged without them and then with them as black
+    void encodeColorETC(const Color32 *block, uint8 *dst) {
+        Color32 c[16];
+        bool clear = false;
+        for (int i = 0; i < 16; i++) {
+            c[i] = block[i].a ? block[i] : Color32(0, 0, 0, 0);
+            clear |= !block[i].a;
+        }
+
+        int bestError = 0x7FFFFFFF;
+
+        for (int mode = 0; mode < (clear ? 4 : 2); mode++) {
+            int  flip     = mode & 1;
+            bool fitClear = mode >> 1;
+            int  pixels[2][8];
+            int  avg[2][3];
+
+            for (int h = 0; h < 2; h++) {
+                int sum[3] = { 0, 0, 0 }, count = 0;
+                for (int i = 0; i < 8; i++) {
+                    int x = flip ? (i & 3) : (h * 2 + (i >> 2));
+                    int y = flip ? (h * 2 + (i >> 2)) : (i & 3);
+                    int p = y * 4 + x;
+                    pixels[h][i] = p;
+                    if (!c[p].a && !fitClear) continue;
+                    sum[0] += c[p].r;
+                    sum[1] += c[p].g;
+                    sum[2] += c[p].b;
+                    count++;
+                }
+                for (int j = 0; j < 3; j++)
+                    avg[h][j] = count ? (sum[j] + count / 2) / count : 0;
+            }
+
+            int q[2][3], base[2][3];
+            bool diff = true;
+            for (int j = 0; j < 3; j++) {
+                q[0][j] = (avg[0][j] * 31 + 127) / 255;
+                q[1][j] = (avg[1][j] * 31 + 127) / 255;
+                int d = q[1][j] - q[0][j];
+                if (d < -4 || d > 3)
+                    diff = false;
+            }
+
+            for (int h = 0; h < 2; h++)
+                for (int j = 0; j < 3; j++) {
+                    if (!diff)
+                        q[h][j] = (avg[h][j] * 15 + 127) / 255;
+                    base[h][j] = diff ? ((q[h][j] << 3) | (q[h][j] >> 2)) : ((q[h][j] << 4) | q[h][j]);
+                }
+
+            int    table[2];
+            uint8  index[2][8];
+            int error = encodeHalfETC(c, pixels[0], base[0], table[0], index[0])
+                      + encodeHalfETC(c, pixels[1], base[1], table[1], index[1]);
+
+            if (error >= bestError)
+                continue;
+            bestError = error;
+
+            for (int j = 0; j < 3; j++)
+                dst[j] = diff ? uint8((q[0][j] << 3) | ((q[1][j] - q[0][j]) & 7)) : uint8((q[0][j] << 4) | q[1][j]);
+            dst[3] = uint8((table[0] << 5) | (table[1] << 2) | (diff ? 2 : 0) | flip);
+
+            uint32 bits = 0;
+            for (int h = 0; h < 2; h++)
+                for (int i = 0; i < 8; i++) {
+                    int p = pixels[h][i];
+                    int j = (p & 3) * 4 + (p >> 2); // column-major pixel order
+                    bits |= ((index[h][i] >> 1) << (j + 16)) | ((index[h][i] & 1) << j);
+                }
+
+            for (int i = 0; i < 4; i++)
+                dst[4 + i] = uint8(bits >> (24 - i * 8));
+        }
+    }
+
+    int getBlockSize(TexFormat format) {
+        return format == FMT_BC1 ? 8 : 16;
+    }
+
+    int getSize(TexFormat format, int width, int height, bool mipmaps) {
+        int size = 0;
+        while (1) {
+            size += ((width + 3) / 4) * ((height + 3) / 4) * getBlockSize(format);
+            if (!mipmaps || (width == 1 && height == 1)) break;
+            width  = max(1, width  / 2);
+            height = max(1, height / 2);
         }
-    } *root;
+        return size;
+    }
+
+// BC1 keeps 1-bit alpha like the RGBA16 atlas, anything with blended texels needs BC3
+    TexFormat getFormat(const Color32 *data, int count) {
+        if (Core::support.texBC) {
+            for (int i = 0; i < count; i++)
+                if (data[i].a != 0 && data[i].a != 255)
+                    return FMT_BC3;
+            return FMT_BC1;
+        }
+
+        if (Core::support.texETC2)
+            return FMT_ETC2;
+
+        return FMT_RGBA;
+    }
+
+    uint8* encode(TexFormat format, const Color32 *data, int width, int height, bool mipmaps) {
+        uint8 *blocks = new uint8[getSize(format, width, height, mipmaps)];
+        uint8 *dst = blocks;
+
+        Color32 *mip = NULL;
+        const Color32 *src = data;
+
+        while (1) {
+            for (int by = 0; by < height; by += 4)
+                for (int bx = 0; bx < width; bx += 4) {
+                    Color32 block[16];
+                    getBlock(src, width, height, bx, by, block);
+
+                    switch (format) {
+                        case FMT_BC1  : encodeColorBC(block, dst, true); break;
+                        case FMT_BC3  : encodeAlphaBC(block, dst); encodeColorBC(block, dst + 8, false); break;
+                        case FMT_ETC2 : encodeAlphaEAC(block, dst); encodeColorETC(block, dst + 8); break;
+                        default       : ASSERT(false);
+                    }
+                    dst += getBlockSize(format);
+                }
+
+            if (!mipmaps || (width == 1 && height == 1)) break;
+
+        // 2x2 box filter of the premultiplied colours
+            int w = max(1, width / 2);
+            int h = max(1, height / 2);
+            Color32 *next = new Color32[w * h];
+            for (int y = 0; y < h; y++)
+                for (int x = 0; x < w; x++) {
+                    const Color32 &a = src[min(y * 2,     height - 1) * width + min(x * 2,     width - 1)];
+                    const Color32 &b = src[min(y * 2,     height - 1) * width + min(x * 2 + 1, width - 1)];
+                    const Color32 &c = src[min(y * 2 + 1, height - 1) * width + min(x * 2,     width - 1)];
+                    const Color32 &d = src[min(y * 2 + 1, height - 1) * width + min(x * 2 + 1, width - 1)];
+                    next[y * w + x] = Color32((a.r + b.r + c.r + d.r + 2) >> 2,
+                                              (a.g + b.g + c.g + d.g + 2) >> 2,
+                                              (a.b + b.b + c.b + d.b + 2) >> 2,
+                                              (a.a + b.a + c.a + d.a + 2) >> 2);
+                }
+
+            delete[] mip;
+            src = mip = next;
+            width  = w;
+            height = h;
+        }
+
+        delete[] mip;
+        return blocks;
+    }
+}
+#endif
+
+#ifdef USE_ATLAS_PALETTE
+    #define ATLAS_PALETTE_SIZE      256
+    #define ATLAS_PALETTE_WHITE     255 // white texture is sampled as the last index
+    #define ATLAS_PALETTE_NEAREST   16  // max count of colours approximated by the nearest palette entry
+    #define ATLAS_PALETTE_BUCKETS   1024
+
+// colours shared by the indexed level atlases
+struct AtlasPalette {
+    AtlasColor colors[ATLAS_PALETTE_SIZE];
+    int16      buckets[ATLAS_PALETTE_BUCKETS]; // open addressing hash table of palette indices
+    int        count;
+
+    AtlasColor extra[ATLAS_PALETTE_NEAREST];
+    uint8      extraIndex[ATLAS_PALETTE_NEAREST];
+    int        extraCount;
+
+    AtlasPalette() : count(0), extraCount(0) {
+        for (int i = 0; i < ATLAS_PALETTE_SIZE; i++)
+            colors[i].value = 0;
+        memset(buckets, 0xFF, sizeof(buckets));
+
+        AtlasColor c;
+        c.value = 0;
+        insert(c, 0); // transparent
+        c.r = c.g = c.b = c.a = 255;
+        insert(c, ATLAS_PALETTE_WHITE);
+        count = 1;
+    }
+
+    static uint32 hash(const AtlasColor &c) {
+        return (uint32(c.value) * 0x9E3779B1) >> 22;
+    }
+
+    void insert(const AtlasColor &c, int index) {
+        uint32 i = hash(c);
+        while (buckets[i] != -1)
+            i = (i + 1) & (ATLAS_PALETTE_BUCKETS - 1);
+        buckets[i] = index;
+        colors[index] = c;
+    }
+
+    int find(const AtlasColor &c) const {
+        for (uint32 i = hash(c); buckets[i] != -1; i = (i + 1) & (ATLAS_PALETTE_BUCKETS - 1))
+            if (colors[buckets[i]].value == c.value)
+                return buckets[i];
+        for (int i = 0; i < extraCount; i++)
+            if (extra[i].value == c.value)
+                return extraIndex[i];
+        return -1;
+    }
+
+    int nearest(const AtlasColor &c) const {
+        int index = 0, minDist = 0x7FFFFFFF;
+        for (int i = 0; i < ATLAS_PALETTE_SIZE; i++) {
+            if (i == count && i < ATLAS_PALETTE_WHITE) {
+                i = ATLAS_PALETTE_WHITE;
+            }
+            const AtlasColor &p = colors[i];
+            int dist = SQR(int(c.r) - int(p.r)) + SQR(int(c.g) - int(p.g)) + SQR(int(c.b) - int(p.b)) + SQR(int(c.a) - int(p.a)) * 16;
+            if (dist < minDist) {
+                minDist = dist;
+                index   = i;
+            }
+        }
+        return index;
+    }
+
+    // collects unique colours of the atlas, fails if it has too many of them
+    bool add(const AtlasColor *data, int size) {
+        for (int i = 0; i < size; i++) {
+            const AtlasColor &c = data[i];
+            if (find(c) != -1)
+                continue;
+
+            if (count < ATLAS_PALETTE_WHITE) {
+                insert(c, count++);
+            } else {
+                if (extraCount == ATLAS_PALETTE_NEAREST)
+                    return false;
+                extra[extraCount++] = c;
+            }
+        }
+        return true;
+    }
+
+    // approximates the colours that didn't fit when all atlases are added
+    void finalize() {
+        for (int i = 0; i < extraCount; i++)
+            extraIndex[i] = nearest(extra[i]);
+    }
+};
+#endif
+
+struct Atlas {
+
+    struct Tile {
+        uint16          id;
+        TR::TextureInfo *tex;
+        short4          uv;
+        short2          pos;
+    } *tiles;
+
+    typedef void (Callback)(Atlas *atlas, int id, int tileX, int tileY, int atalsWidth, int atlasHeight, Tile &tile, void *userData, void *data);
+
+    struct TileRef {
+        Tile  *tile;
+        int16 w, h;
+
+        static int cmp(const TileRef &a, const TileRef &b) {
+            if (a.h != b.h) return b.h - a.h;
+            return b.w - a.w;
+        }
+    };
+
+    struct Segment {    // skyline segment
+        int16 x, y, width;
+    } *skyline;
 
     int      tilesCount;
+    int      segmentsCount;
     int      size;
     int      width, height;
     short4   border;
+    int      *buckets;  // open addressing hash table of unique tile indices
+    uint32   bucketsMask;
     void     *userData;
     Callback *callback;
 
-    Atlas(int maxTiles, short4 border, void *userData, Callback *callback) : root(NULL), tilesCount(0), size(0), border(border), userData(userData), callback(callback) {
+    Atlas(int maxTiles, short4 border, void *userData, Callback *callback) : skyline(NULL), tilesCount(0), segmentsCount(0), size(0), border(border), userData(userData), callback(callback) {
         tiles = new Tile[maxTiles];
+
+        bucketsMask = nextPow2(maxTiles * 2) - 1;
+        buckets = new int[bucketsMask + 1];
+        memset(buckets, 0xFF, (bucketsMask + 1) * sizeof(int));
     }
 
     ~Atlas() {
-        delete root;
+        delete[] skyline;
+        delete[] buckets;
         delete[] tiles;
     }
 
+    static uint32 hashTile(const short4 &uv, const TR::TextureInfo *tex) {
+        uint32 hash = fnv32((const char*)&uv, sizeof(uv));
+        hash = fnv32((const char*)&tex->tile, sizeof(tex->tile), hash);
+        hash = fnv32((const char*)&tex->clut, sizeof(tex->clut), hash);
+        return hash ^ tex->type;
+    }
+
     void add(uint16 id, short4 uv, TR::TextureInfo *tex) {
-        for (int i = 0; i < tilesCount; i++)
-            if (tiles[i].uv == uv && tiles[i].tex->type == tex->type && tiles[i].tex->tile == tex->tile && tiles[i].tex->clut == tex->clut) {
+        uint32 i = hashTile(uv, tex) & bucketsMask;
+
+        for (; buckets[i] != -1; i = (i + 1) & bucketsMask) {
+            Tile &t = tiles[buckets[i]];
+            if (t.uv == uv && t.tex->type == tex->type && t.tex->tile == tex->tile && t.tex->clut == tex->clut) {
                 uv.x = 0x7FFF;
-                uv.y = tiles[i].id;
+                uv.y = t.id;
                 uv.z = uv.w = 0;
                 break;
             }
+        }
+
+        if (uv.x != 0x7FFF) {
+            buckets[i] = tilesCount;
+            size += (uv.z - uv.x + border.x + border.z) * (uv.w - uv.y + border.y + border.w);
+        }
 
         tiles[tilesCount].id  = id;
         tiles[tilesCount].tex = tex;
         tiles[tilesCount].uv  = uv;
         tilesCount++;
+    }
 
-        if (uv.x != 0x7FFF)
-            size += (uv.z - uv.x + border.x + border.z) * (uv.w - uv.y + border.y + border.w);
+    bool insert(Tile &tile) {
+        ASSERT(tile.uv.x != 0x7FFF);
+
+        int w = (tile.uv.z - tile.uv.x) + border.x + border.z;
+        int h = (tile.uv.w - tile.uv.y) + border.y + border.w;
+
+    // find the lowest fit (bottom-left rule, the narrowest segment wins a tie)
+        int bestIndex = -1, bestY = height, bestWidth = width + 1;
+
+        for (int i = 0; i < segmentsCount; i++) {
+            Segment &s = skyline[i];
+
+            if (s.x + w > width)
+                break;
+
+            int y = s.y;
+            for (int j = i, left = w; left > 0; j++) {
+                y = max(y, int(skyline[j].y));
+                left -= skyline[j].width;
+            }
+
+            if (y + h > bestY || (y + h == bestY && s.width >= bestWidth))
+                continue;
+
+            bestIndex = i;
+            bestY     = y + h;
+            bestWidth = s.width;
+        }
+
+        if (bestIndex == -1)
+            return false;
+
+        int x = skyline[bestIndex].x;
+        tile.pos = short2(x, bestY - h);
+
+    // raise the skyline under the tile
+        memmove(skyline + bestIndex + 1, skyline + bestIndex, (segmentsCount - bestIndex) * sizeof(Segment));
+        segmentsCount++;
+
+        Segment &s = skyline[bestIndex];
+        s.x     = x;
+        s.y     = bestY;
+        s.width = w;
+
+        int i = bestIndex + 1;
+        while (i < segmentsCount && skyline[i].x < x + w) {
+            int overlap = x + w - skyline[i].x;
+            if (skyline[i].width > overlap) {
+                skyline[i].x     += overlap;
+                skyline[i].width -= overlap;
+                break;
+            }
+            memmove(skyline + i, skyline + i + 1, (segmentsCount - i - 1) * sizeof(Segment));
+            segmentsCount--;
+        }
+
+    // merge neighbours of the same height
+        for (i = max(bestIndex - 1, 0); i < min(bestIndex + 1, segmentsCount - 1); ) {
+            if (skyline[i].y == skyline[i + 1].y) {
+                skyline[i].width += skyline[i + 1].width;
+                memmove(skyline + i + 1, skyline + i + 2, (segmentsCount - i - 2) * sizeof(Segment));
+                segmentsCount--;
+            } else
+                i++;
+        }
+
+        return true;
     }
 
-    bool insertAll(int *indices) {
-        for (int i = 0; i < tilesCount; i++) {
-            int idx = indices[i];
-            if (tiles[idx].uv.x != 0x7FFF && !root->insert(this, tiles[idx].uv, idx))
+    bool insertAll(TileRef *refs, int count) {
+        segmentsCount = 1;
+        skyline[0].x     = 0;
+        skyline[0].y     = 0;
+        skyline[0].width = width;
+
+        for (int i = 0; i < count; i++)
+            if (!insert(*refs[i].tile))
                 return false;
-        }
         return true;
     }
 
-    Texture* pack(uint32 opt) {
+#ifdef USE_ATLAS_COMPRESSION
+    #define ATLAS_CACHE_MAGIC 0x434C5441 // "ATLC"
+
+    struct CacheHeader {
+        uint32 magic;
+        uint32 format;
+        int32  width, height, size;
+    };
+
+    struct CompressJob {
+        Atlas     *atlas;
+        TexFormat format;
+        uint32    opt;
+        Texture   *texture;
+    };
+
+    static void cacheLoaded(Stream *stream, void *userData) {
+        CompressJob *job = (CompressJob*)userData;
+        Atlas *atlas = job->atlas;
+
+        CacheHeader header;
+        int size = TexCompress::getSize(job->format, atlas->width, atlas->height, (job->opt & OPT_MIPMAPS) != 0);
+
+        if (stream && stream->size == int(sizeof(header)) + size) {
+            stream->raw(&header, sizeof(header));
+
+            if (header.magic == ATLAS_CACHE_MAGIC && header.format == uint32(job->format) && header.width == atlas->width && header.height == atlas->height && header.size == size) {
+                uint8 *data = new uint8[size];
+                stream->raw(data, size);
+                job->texture = new Texture(atlas->width, atlas->height, 1, job->format, job->opt, data);
+                delete[] data;
+            }
+        }
+
+        delete stream;
+    }
+
+    // encodes the atlas on the first load and keeps the blocks in the cache, keyed by the atlas content
+    Texture* packCompressed(AtlasColor *data, uint32 opt) {
+        CompressJob job;
+        job.atlas   = this;
+        job.format  = TexCompress::getFormat(data, width * height);
+        job.opt     = opt;
+        job.texture = NULL;
+
+        if (job.format == FMT_RGBA)
+            return NULL;
+
+        char name[64];
+        sprintf(name, "atlas_%08X_%d_%d", fnv32((char*)data, width * height * sizeof(data[0])), int(job.format), int(opt));
+
+    #ifdef OS_FILEIO_CACHE
+        Stream::cacheRead(name, cacheLoaded, &job); // file based cache is synchronous
+    #endif
+
+        if (!job.texture) {
+            bool mipmaps = (opt & OPT_MIPMAPS) != 0;
+            int size = TexCompress::getSize(job.format, width, height, mipmaps);
+
+            char *blob = new char[sizeof(CacheHeader) + size];
+            CacheHeader &header = *(CacheHeader*)blob;
+            header.magic  = ATLAS_CACHE_MAGIC;
+            header.format = job.format;
+            header.width  = width;
+            header.height = height;
+            header.size   = size;
+
+            uint8 *blocks = TexCompress::encode(job.format, data, width, height, mipmaps);
+            memcpy(blob + sizeof(CacheHeader), blocks, size);
+            delete[] blocks;
+
+            job.texture = new Texture(width, height, 1, job.format, opt, blob + sizeof(CacheHeader));
+
+        #ifdef OS_FILEIO_CACHE
+            Stream::cacheWrite(name, blob, sizeof(CacheHeader) + size);
+        #endif
+            delete[] blob;
+        }
+
+        LOG("atlas   : %s %d x %d\n", job.format == FMT_BC1 ? "BC1" : (job.format == FMT_BC3 ? "BC3" : "ETC2"), width, height);
+
+        return job.texture;
+    }
+#endif
+
+    AtlasColor* build() {
     // TODO TR2 fix CUT2 AV
 //        width  = 4096;//nextPow2(int(sqrtf(float(size))));
 //        height = 2048;//(width * width / 2 > size) ? (width / 2) : width;
         width  = max(1, nextPow2(int(sqrtf(float(size)))));
         height = max(1, (width * width / 2 > size) ? (width / 2) : width);
-    // sort
-        int *indices = new int[tilesCount];
-        for (int i = 0; i < tilesCount; i++)
-            indices[i] = i;
-
-        int n = tilesCount;
-        bool swapped;
-        do {
-            swapped = false;
-            for (int i = 1; i < n; i++) {
-                short4 &a = tiles[indices[i - 1]].uv;
-                short4 &b = tiles[indices[i]].uv;
-                //if ((a.z - a.x + ATLAS_BORDER * 2) * (a.w - a.y + ATLAS_BORDER * 2) < (b.z - b.x + ATLAS_BORDER * 2) * (b.w - b.y + ATLAS_BORDER * 2)) {
-                if ((a.z - a.x) < (b.z - b.x)) {
-                    swap(indices[i - 1], indices[i]);
-                    swapped = true;
-                }
-            }
-            n--;
-        } while (swapped);
-    // pack
-        while (1) {
-            delete root;
-            root = new Node(0, 0, width - 1, height - 1);
+    // sort unique tiles by height, then by width
+        TileRef *refs = new TileRef[tilesCount];
+        int count = 0;
+        for (int i = 0; i < tilesCount; i++) {
+            Tile &t = tiles[i];
+            if (t.uv.x == 0x7FFF) continue;
+            TileRef &ref = refs[count++];
+            ref.tile = &t;
+            ref.w    = t.uv.z - t.uv.x;
+            ref.h    = t.uv.w - t.uv.y;
+        }
 
-            if (insertAll(indices)) 
-                break;
+        sort(refs, count);
+    // pack
+        delete[] skyline;
+        skyline = new Segment[count + 1];
 
+        while (!insertAll(refs, count)) {
             if (width < height)
                 width  *= 2;
             else
                 height *= 2;
         }
 
-        delete[] indices;
+        delete[] refs;
 
         AtlasColor *data = new AtlasColor[width * height];
         memset(data, 0, width * height * sizeof(data[0]));
-        fill(root, data);
+        fill(data);
         fillInstances();
 
-        Texture *atlas = new Texture(width, height, 1, ATLAS_FORMAT, opt, data);
+        return data;
+    }
+
+    Texture* upload(AtlasColor *data, uint32 opt, bool compress = false) {
+        Texture *atlas = NULL;
+    #ifdef USE_ATLAS_COMPRESSION
+        if (compress)
+            atlas = packCompressed(data, opt);
+    #endif
+        if (!atlas)
+            atlas = new Texture(width, height, 1, ATLAS_FORMAT, opt, data);
 
         //Texture::SaveBMP("atlas", (char*)data, width, height);
 
         delete[] data;
         return atlas;
-    };
+    }
 
-    void fill(Node *node, void *data) {
-        if (!node) return;
+#ifdef USE_ATLAS_PALETTE
+    // converts the atlas to palette indices, every mip texel takes the colour of its 2x2 block closest to their average
+    Texture* upload(AtlasColor *data, uint32 opt, const AtlasPalette &palette) {
+        bool mipmaps = (opt & OPT_MIPMAPS) != 0;
 
-        if (node->tileIndex == -1) {
-            fill(node->child[0], data);
-            fill(node->child[1], data);
-        } else
-            callback(this, tiles[node->tileIndex].id, node->rect.x, node->rect.y, width, height, tiles[node->tileIndex], userData, data);
+        int size = 0;
+        for (int w = width, h = height; ; w = max(1, w / 2), h = max(1, h / 2)) {
+            size += w * h;
+            if (!mipmaps || (w == 1 && h == 1)) break;
+        }
+
+        uint8 *indices = new uint8[size];
+        for (int i = 0; i < width * height; i++) {
+            int index = palette.find(data[i]);
+            ASSERT(index != -1);
+            indices[i] = index;
+        }
+
+        uint8 *src = indices;
+        for (int w = width, h = height; mipmaps && (w > 1 || h > 1); ) {
+            int dw = max(1, w / 2);
+            int dh = max(1, h / 2);
+            uint8 *dst = src + w * h;
+
+            for (int y = 0; y < dh; y++) {
+                for (int x = 0; x < dw; x++) {
+                    int sx = x * 2, sy = y * 2;
+                    uint8 block[4] = {
+                        src[sy * w + sx],
+                        src[sy * w + min(sx + 1, w - 1)],
+                        src[min(sy + 1, h - 1) * w + sx],
+                        src[min(sy + 1, h - 1) * w + min(sx + 1, w - 1)]
+                    };
+
+                    int r = 0, g = 0, b = 0, a = 0;
+                    for (int i = 0; i < 4; i++) {
+                        const AtlasColor &c = palette.colors[block[i]];
+                        r += c.r;
+                        g += c.g;
+                        b += c.b;
+                        a += c.a;
+                    }
+
+                    int index = 0, minDist = 0x7FFFFFFF;
+                    for (int i = 0; i < 4; i++) {
+                        const AtlasColor &c = palette.colors[block[i]];
+                        int dist = SQR(c.r * 4 - r) + SQR(c.g * 4 - g) + SQR(c.b * 4 - b) + SQR(c.a * 4 - a);
+                        if (dist < minDist) {
+                            minDist = dist;
+                            index   = i;
+                        }
+                    }
+                    dst[y * dw + x] = block[index];
+                }
+            }
+
+            src = dst;
+            w   = dw;
+            h   = dh;
+        }
+
+        Texture *atlas = new Texture(width, height, 1, FMT_INDEX, opt, indices);
+
+        LOG("atlas   : INDEX %d x %d\n", width, height);
+
+        delete[] indices;
+        delete[] data;
+        return atlas;
+    }
+#endif
+
+    Texture* pack(uint32 opt, bool compress = false) {
+        return upload(build(), opt, compress);
+    }
+
+    void fill(void *data) {
+        for (int i = 0; i < tilesCount; i++)
+            if (tiles[i].uv.x != 0x7FFF)
+                callback(this, tiles[i].id, tiles[i].pos.x, tiles[i].pos.y, width, height, tiles[i], userData, data);
     }
 
     void fillInstances() {
@@ -0,0 +1,911 @@
+// PHD -> PKD level packer for the fixed-point port (src/platform/gba)
+// all the remapping is done here, so readLevel on the device only fixes up the offsets
+//
+// build (from this folder):
+//   g++ -std=c++11 -O2 -D_POSIX_THREADS -D_POSIX_READER_WRITER_LOCKS -DSTR_LANG_HI=1000 -DSTR_HI=STR_EN -I../.. main.cpp
+//       ../../libs/stb_vorbis/stb_vorbis.c ../../libs/minimp3/minimp3.cpp ../../libs/tinf/tinflate.c -o packer -lGL -lX11 -lpthread
+// usage:
+//   packer [-o output_dir] LEVEL1.PHD LEVEL2.PHD ...
+
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+
+#include "core.h"
+#include "sound.h"
+#include "format.h"
+
+// platform callbacks required by the engine headers
+int osGetTimeMS() { return 0; }
+bool osJoyReady(int index) { return false; }
+void osJoyVibrate(int index, float L, float R) {}
+
+// the layout below must match platform/gba/common.h (32-bit, offsets instead of pointers)
+#define PKD_MAGIC           0x32444B50 // "PKD2"
+#define PKD_MAX_MODELS      TR::Entity::TR1_TYPE_MAX // ITEM_MAX
+#define PKD_MAX_STATICS     50  // MAX_STATIC_MESHES
+#define PKD_SHADES          32  // lightmap rows
+#define PKD_FOG_MAX         (10 * 1024)             // FOG_MAX
+#define PKD_FOG_MIN         (PKD_FOG_MAX - 4096)    // FOG_MIN
+#define PKD_FOG_STEP_SHIFT  7                       // FOG_STEP_SHIFT, one shade per step
+#define PKD_FOG_STEPS       (PKD_FOG_MAX >> PKD_FOG_STEP_SHIFT)
+
+#define FACE_COLORED        0x4000
+#define FACE_TEXTURE        0x07FF
+
+#define NO_ROOM             0xFF
+
+namespace PKD {
+
+    struct Header {
+        uint32 magic;
+
+        uint16 tilesCount;
+        uint16 roomsCount;
+        uint16 modelsCount;
+        uint16 staticMeshesCount;
+        uint16 spriteSequencesCount;
+        uint16 soundSourcesCount;
+        uint16 boxesCount;
+        uint16 animTexDataSize;
+        uint16 itemsCount;
+        uint16 cameraFramesCount;
+
+        uint32 palette;
+        uint32 lightmap;
+        uint32 fogTable;
+        uint32 tiles;
+        uint32 roomsInfo;
+        uint32 floors;
+        uint32 meshData;
+        uint32 meshOffsets;
+        uint32 anims;
+        uint32 animStates;
+        uint32 animRanges;
+        uint32 animCommands;
+        uint32 nodes;
+        uint32 animFrames;
+        uint32 models;
+        uint32 staticMeshes;
+        uint32 textures;
+        uint32 sprites;
+        uint32 spriteSequences;
+        uint32 cameras;
+        uint32 soundSources;
+        uint32 boxes;
+        uint32 overlaps;
+        uint32 zones[2][3];
+        uint32 animTexData;
+        uint32 itemsInfo;
+        uint32 cameraFrames;
+        uint32 soundMap;
+        uint32 soundsInfo;
+        uint32 soundData;
+        uint32 soundOffsets;
+    };
+
+    struct RoomInfo {
+        int16  x, z;
+        int16  yBottom, yTop;
+
+        uint16 quadsCount;
+        uint16 trianglesCount;
+        uint16 verticesCount;
+        uint16 spritesCount;
+
+        uint8  portalsCount;
+        uint8  lightsCount;
+        uint8  meshesCount;
+        uint8  ambient;
+
+        uint8  xSectors;
+        uint8  zSectors;
+        uint8  alternateRoom;
+        uint8  flags;
+
+        uint32 quads;
+        uint32 triangles;
+        uint32 vertices;
+        uint32 sprites;
+        uint32 portals;
+        uint32 sectors;
+        uint32 lights;
+        uint32 meshes;
+    };
+
+    struct Quad {
+        int16  indices[4];
+        uint16 flags;
+    };
+
+    struct Triangle {
+        int16  indices[3];
+        uint16 flags;
+    };
+
+    struct RoomVertex {
+        int8   x, y, z;
+        uint8  g;
+    };
+
+    struct RoomSprite {
+        int16  x, y, z;
+        uint8  g;
+        uint8  reserved;
+        uint16 texture;
+    };
+
+    struct Sector {
+        uint16 floorIndex;
+        uint16 boxIndex;
+        uint8  roomBelow;
+        int8   floor;
+        uint8  roomAbove;
+        int8   ceiling;
+    };
+
+    struct Light {
+        short3 pos;
+        uint8  radius;
+        uint8  intensity;
+    };
+
+    struct RoomMesh {
+        short3 pos;
+        uint8  intensity;
+        uint8  id:6, rot:2;
+    };
+
+    struct Anim {
+        uint32 frameOffset;
+        uint8  frameRate;
+        uint8  frameSize;
+        uint16 state;
+        int32  speed;
+        int32  accel;
+        uint16 frameBegin;
+        uint16 frameEnd;
+        uint16 nextAnimIndex;
+        uint16 nextFrameIndex;
+        uint16 statesCount;
+        uint16 statesStart;
+        uint16 commandsCount;
+        uint16 commandsStart;
+    };
+
+    struct AnimState {
+        uint8  state;
+        uint8  rangesCount;
+        uint16 rangesStart;
+    };
+
+    struct Model {
+        uint8  type;
+        int8   count;
+        uint16 start;
+        uint16 nodeIndex;
+        uint16 animIndex;
+    };
+
+    struct Bounds {
+        int16 minX, maxX, minY, maxY, minZ, maxZ;
+    };
+
+    struct StaticMesh {
+        uint16 id;
+        uint16 meshIndex;
+        uint16 flags;
+        Bounds vbox;
+        Bounds cbox;
+    };
+
+    struct Texture {
+        uint16 attribute;
+        uint16 tile;
+        uint32 uv[4];
+    };
+
+    struct Sprite {
+        uint16 tile;
+        uint8  u, v;
+        uint16 w, h;
+        int16  l, t, r, b;
+    };
+
+    struct SpriteSeq {
+        uint16 type;
+        uint16 unused;
+        int16  count;
+        int16  start;
+    };
+
+    struct Box {
+        int8   minZ, maxZ;
+        int8   minX, maxX;
+        int16  floor;
+        uint16 overlap;
+    };
+
+    struct ItemInfo {
+        uint8  type;
+        uint8  roomIndex;
+        short3 pos;
+        uint16 intensity;
+        uint16 flags;
+    };
+
+    struct SoundInfo {
+        uint16 index;
+        uint16 volume;
+        uint16 chance;
+        uint16 flags;
+    };
+}
+
+struct Writer {
+    FILE *f;
+
+    Writer(FILE *f) : f(f) {}
+
+    uint32 tell() {
+        return uint32(ftell(f));
+    }
+
+    void align() {
+        static const uint8 zero[4] = { 0 };
+        uint32 pos = tell();
+        if (pos & 3)
+            fwrite(zero, 1, 4 - (pos & 3), f);
+    }
+
+    // returns the offset of the written block, 0 for empty ones
+    uint32 write(const void *data, int size) {
+        if (!size) return 0;
+        align();
+        uint32 offset = tell();
+        fwrite(data, 1, size, f);
+        return offset;
+    }
+
+    template <typename T>
+    uint32 write(const T *items, int count) {
+        return write((const void*)items, int(sizeof(T)) * count);
+    }
+
+    void patch(uint32 offset, const void *data, int size) {
+        uint32 pos = tell();
+        fseek(f, offset, SEEK_SET);
+        fwrite(data, 1, size, f);
+        fseek(f, pos, SEEK_SET);
+    }
+};
+
+// TR::Level trusts the counts stored in the file, so a damaged or non-retail level is walked here first
+// and every array is checked against the file size before it gets parsed
+struct Checker {
+    const uint8 *data;
+    int         size;
+    int         pos;
+    const char  *error;
+
+    Checker(const uint8 *data, int size) : data(data), size(size), pos(0), error(NULL) {}
+
+    bool skip(int64 bytes, const char *what) {
+        if (error) return false;
+        if (bytes < 0 || pos + bytes > size) {
+            error = what;
+            return false;
+        }
+        pos += int(bytes);
+        return true;
+    }
+
+    uint32 count(int bytes, const char *what) { // 16 or 32-bit little-endian
+        if (!skip(bytes, what)) return 0;
+        const uint8 *p = data + pos - bytes;
+        return bytes == 2 ? (p[0] | (p[1] << 8)) : (p[0] | (p[1] << 8) | (p[2] << 16) | (uint32(p[3]) << 24));
+    }
+
+    void array(int countBytes, int itemSize, const char *what) {
+        skip(int64(count(countBytes, what)) * itemSize, what);
+    }
+};
+
+// returns the name of the first block that doesn't fit into the file, NULL for a valid TR1 PC level
+const char* checkLevel(const uint8 *data, int size, const char *name) {
+    Checker c(data, size);
+
+    if (c.count(4, "header") != 0x00000020)
+        return c.error ? c.error : "header";
+
+    TR::Version version;
+    bool isDemoLevel;
+    TR::getLevelID(size, name, version, isDemoLevel);
+
+    c.array(4, 256 * 256, "tiles");
+    c.skip(4, "header");
+
+    int roomsCount = c.count(2, "rooms");
+    for (int i = 0; i < roomsCount && !c.error; i++) {
+        c.skip(16, "room info");
+
+        int64 dataSize = int64(c.count(4, "room data")) * 2;
+        if (c.error || c.pos + dataSize > size)
+            return "room data";
+
+        Checker d(data + c.pos, int(dataSize));
+        d.array(2, 8,  "room vertices");
+        d.array(2, 10, "room quads");
+        d.array(2, 8,  "room triangles");
+        d.array(2, 4,  "room sprites");
+        if (d.error)
+            return d.error;
+        c.skip(dataSize, "room data");
+
+        c.array(2, 32, "room portals");
+        int64 zSectors = c.count(2, "room sectors");
+        int64 xSectors = c.count(2, "room sectors");
+        c.skip(zSectors * xSectors * 8, "room sectors");
+        c.skip(2, "room ambient");
+        c.array(2, 18, "room lights");
+        c.array(2, 18, "room meshes");
+        c.skip(4, "room flags");
+    }
+
+    c.array(4, 2,  "floors");
+    c.array(4, 2,  "mesh data");
+    c.array(4, 4,  "mesh offsets");
+    c.array(4, 32, "anims");
+    c.array(4, 6,  "anim states");
+    c.array(4, 8,  "anim ranges");
+    c.array(4, 2,  "anim commands");
+    c.array(4, 4,  "nodes");
+    c.array(4, 2,  "frames");
+    c.array(4, 18, "models");
+    c.array(4, 32, "static meshes");
+    c.array(4, 20, "object textures");
+    c.array(4, 16, "sprite textures");
+    c.array(4, 8,  "sprite sequences");
+    if (isDemoLevel)
+        c.skip(256 * 3, "palette");
+    c.array(4, 16, "cameras");
+    c.array(4, 16, "sound sources");
+
+    int64 boxesCount = c.count(4, "boxes");
+    c.skip(boxesCount * 20, "boxes");
+    c.array(4, 2, "overlaps");
+    c.skip(boxesCount * 2 * 6, "zones");
+
+    c.array(4, 2,  "animated textures");
+    c.array(4, 22, "items");
+    c.skip(32 * 256, "lightmap");
+    if (!isDemoLevel)
+        c.skip(256 * 3, "palette");
+    c.array(2, 16, "camera frames");
+    c.array(2, 1,  "demo data");
+    c.skip(256 * 2, "sound map");
+    c.array(4, 8,  "sound infos");
+    c.array(4, 1,  "sound data");
+    c.array(4, 4,  "sound offsets");
+
+    return c.error;
+}
+
+uint8 getShade(uint8 brightness) { // lightmap row, 0 (bright) .. 31 (dark)
+    return (255 - brightness) >> 3;
+}
+
+// rooms are written as the info table followed by the data of each room
+uint32 writeRooms(Writer &out, const TR::Level &level) {
+    PKD::RoomInfo *infos = new PKD::RoomInfo[level.roomsCount];
+    memset(infos, 0, sizeof(PKD::RoomInfo) * level.roomsCount);
+
+    uint32 offset = out.write(infos, level.roomsCount);
+
+    for (int i = 0; i < level.roomsCount; i++) {
+        const TR::Room &room = level.rooms[i];
+        const TR::Room::Data &data = room.data;
+        PKD::RoomInfo &info = infos[i];
+
+        info.x              = int16(room.info.x >> 8);
+        info.z              = int16(room.info.z >> 8);
+        info.yBottom        = int16(room.info.yBottom);
+        info.yTop           = int16(room.info.yTop);
+        info.verticesCount  = data.vCount;
+        info.spritesCount   = data.sCount;
+        info.portalsCount   = uint8(room.portalsCount);
+        info.lightsCount    = uint8(room.lightsCount);
+        info.meshesCount    = uint8(room.meshesCount);
+        info.ambient        = uint8(room.ambient >> 5);
+        info.xSectors       = uint8(room.xSectors);
+        info.zSectors       = uint8(room.zSectors);
+        info.alternateRoom  = room.alternateRoom == -1 ? NO_ROOM : uint8(room.alternateRoom);
+        info.flags          = uint8(room.flags.value);
+
+    // split faces into quads and triangles
+        PKD::Quad     *quads     = new PKD::Quad[data.fCount];
+        PKD::Triangle *triangles = new PKD::Triangle[data.fCount];
+
+        for (int j = 0; j < data.fCount; j++) {
+            const TR::Face &f = data.faces[j];
+            if (f.triangle) {
+                PKD::Triangle &t = triangles[info.trianglesCount++];
+                for (int k = 0; k < 3; k++)
+                    t.indices[k] = f.vertices[k];
+                t.flags = f.flags.texture & FACE_TEXTURE;
+            } else {
+                PKD::Quad &q = quads[info.quadsCount++];
+                for (int k = 0; k < 4; k++)
+                    q.indices[k] = f.vertices[k];
+                q.flags = f.flags.texture & FACE_TEXTURE;
+            }
+        }
+
+    // room vertices are aligned to the sector grid (x, z) and the click (y), sprites keep the full position
+        bool *isSprite = new bool[data.vCount];
+        memset(isSprite, 0, sizeof(bool) * data.vCount);
+        for (int j = 0; j < data.sCount; j++)
+            isSprite[data.sprites[j].vertexIndex] = true;
+
+        PKD::RoomVertex *vertices = new PKD::RoomVertex[data.vCount];
+        for (int j = 0; j < data.vCount; j++) {
+            const TR::Room::Data::Vertex &v = data.vertices[j];
+            if (!isSprite[j] && ((v.pos.x & 1023) || (v.pos.z & 1023) || (v.pos.y & 255)))
+                LOG("! room %d vertex %d is not aligned (%d %d %d)\n", i, j, v.pos.x, v.pos.y, v.pos.z);
+            vertices[j].x = int8(v.pos.x >> 10);
+            vertices[j].y = int8(v.pos.y >> 8);
+            vertices[j].z = int8(v.pos.z >> 10);
+            vertices[j].g = getShade(v.color.r);
+        }
+
+        PKD::RoomSprite *sprites = new PKD::RoomSprite[data.sCount];
+        for (int j = 0; j < data.sCount; j++) {
+            const TR::Room::Data::Vertex &v = data.vertices[data.sprites[j].vertexIndex];
+            PKD::RoomSprite &s = sprites[j];
+            s.x         = v.pos.x;
+            s.y         = v.pos.y;
+            s.z         = v.pos.z;
+            s.g         = getShade(v.color.r);
+            s.reserved  = 0;
+            s.texture   = data.sprites[j].texture;
+        }
+
+        PKD::Sector *sectors = new PKD::Sector[room.xSectors * room.zSectors];
+        for (int j = 0; j < room.xSectors * room.zSectors; j++) {
+            const TR::Room::Sector &src = room.sectors[j];
+            PKD::Sector &s = sectors[j];
+            s.floorIndex = src.floorIndex;
+            s.boxIndex   = src.boxIndex;
+            s.roomBelow  = src.roomBelow;
+            s.floor      = src.floor;
+            s.roomAbove  = src.roomAbove;
+            s.ceiling    = src.ceiling;
+        }
+
+        PKD::Light *lights = new PKD::Light[room.lightsCount];
+        for (int j = 0; j < room.lightsCount; j++) {
+            const TR::Room::Light &src = room.lights[j];
+            PKD::Light &l = lights[j];
+            l.pos       = short3(src.x - room.info.x, src.y, src.z - room.info.z);
+            l.radius    = uint8(min(int(src.radius / 2) >> 8, 255)); // undo the fade scale of the loader
+            l.intensity = uint8(min(src.intensity, 0x1FFF) >> 5);
+        }
+
+        PKD::RoomMesh *meshes = new PKD::RoomMesh[room.meshesCount];
+        for (int j = 0; j < room.meshesCount; j++) {
+            const TR::Room::Mesh &src = room.meshes[j];
+            PKD::RoomMesh &m = meshes[j];
+            ASSERT(src.meshID < PKD_MAX_STATICS);
+            m.pos       = short3(src.x - room.info.x, src.y, src.z - room.info.z);
+            m.intensity = getShade(src.color.r);
+            m.id        = src.meshID;
+            m.rot       = ((src.rotation.value >> 14) + 2) & 3;
+        }
+
+        info.quads     = out.write(quads,         info.quadsCount);
+        info.triangles = out.write(triangles,     info.trianglesCount);
+        info.vertices  = out.write(vertices,      data.vCount);
+        info.sprites   = out.write(sprites,       data.sCount);
+        info.portals   = out.write(room.portals,  room.portalsCount);
+        info.sectors   = out.write(sectors,       room.xSectors * room.zSectors);
+        info.lights    = out.write(lights,        room.lightsCount);
+        info.meshes    = out.write(meshes,        room.meshesCount);
+
+        delete[] quads;
+        delete[] triangles;
+        delete[] isSprite;
+        delete[] vertices;
+        delete[] sprites;
+        delete[] sectors;
+        delete[] lights;
+        delete[] meshes;
+    }
+
+    out.patch(offset, infos, sizeof(PKD::RoomInfo) * level.roomsCount);
+    delete[] infos;
+
+    return offset;
+}
+
+// mesh data keeps the original layout read by drawMesh, but normals are replaced by shades
+// and faces are pre-split into textured and colored lists with the final flags
+void writeMesh(Array<uint16> &data, const TR::Mesh &mesh) {
+    data.push(mesh.center.x);
+    data.push(mesh.center.y);
+    data.push(mesh.center.z);
+    data.push(mesh.radius);
+    data.push(mesh.flags.value);
+
+    data.push(mesh.vCount);
+    for (int i = 0; i < mesh.vCount; i++) {
+        data.push(mesh.vertices[i].coord.x);
+        data.push(mesh.vertices[i].coord.y);
+        data.push(mesh.vertices[i].coord.z);
+    }
+
+    data.push(uint16(-mesh.vCount));
+    for (int i = 0; i < mesh.vCount; i++)
+        data.push(mesh.vertices[i].coord.w);
+
+    for (int pass = 0; pass < 4; pass++) {
+        bool colored  = pass >= 2;
+        bool triangle = pass & 1;
+
+        int count = 0;
+        for (int i = 0; i < mesh.fCount; i++) {
+            const TR::Face &f = mesh.faces[i];
+            if (f.colored == colored && f.triangle == triangle)
+                count++;
+        }
+
+        data.push(count);
+        for (int i = 0; i < mesh.fCount; i++) {
+            const TR::Face &f = mesh.faces[i];
+            if (f.colored != colored || f.triangle != triangle) continue;
+
+            for (int k = 0; k < (triangle ? 3 : 4); k++)
+                data.push(f.vertices[k]);
+            data.push(colored ? ((f.flags.value & 0xFF) | FACE_COLORED) : (f.flags.texture & FACE_TEXTURE));
+        }
+    }
+}
+
+bool pack(const char *src, const char *dst) {
+    FILE *f = fopen(src, "rb");
+    if (!f) {
+        printf("! can't open \"%s\"\n", src);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    int size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buffer = new char[size];
+    size = int(fread(buffer, 1, size, f));
+    fclose(f);
+
+    const char *name = strrchr(src, '/');
+    name = name ? name + 1 : src;
+
+    const char *error = checkLevel((uint8*)buffer, size, name);
+    if (error) {
+        printf("! \"%s\" is not a valid TR1 PC level (bad %s)\n", src, error);
+        delete[] buffer;
+        return false;
+    }
+
+    Stream stream(name, buffer, size);
+    TR::Level level(stream);
+    delete[] buffer;
+
+    if (level.version != TR::VER_TR1_PC) {
+        printf("! \"%s\" is not a TR1 PC level\n", src);
+        return false;
+    }
+
+    f = fopen(dst, "wb");
+    if (!f) {
+        printf("! can't create \"%s\"\n", dst);
+        return false;
+    }
+
+    Writer out(f);
+
+    PKD::Header header;
+    memset(&header, 0, sizeof(header));
+    out.write(&header, 1);
+
+    header.magic = PKD_MAGIC;
+
+// palette & lightmap
+    uint16 palette[256];
+    for (int i = 0; i < 256; i++) {
+        const Color24 &c = level.palette[i];
+        palette[i] = (c.r >> 3) | ((c.g >> 3) << 5) | ((c.b >> 3) << 10);
+    }
+    header.palette  = out.write(palette, 256);
+    header.lightmap = out.write(level.lightmap, sizeof(level.lightmap));
+
+// fog, the lightmap row of the shade at the depth step
+    uint8 fogTable[PKD_FOG_STEPS * PKD_SHADES];
+    for (int i = 0; i < PKD_FOG_STEPS; i++) {
+        int fog = max(0, (i << PKD_FOG_STEP_SHIFT) - PKD_FOG_MIN) >> PKD_FOG_STEP_SHIFT;
+        for (int j = 0; j < PKD_SHADES; j++)
+            fogTable[i * PKD_SHADES + j] = uint8(min(j + fog, PKD_SHADES - 1));
+    }
+    header.fogTable = out.write(fogTable, sizeof(fogTable));
+
+// tiles
+    header.tilesCount = level.tilesCount;
+    header.tiles      = out.write(level.tiles8, level.tilesCount);
+
+// rooms & floor data
+    header.roomsCount = level.roomsCount;
+    header.roomsInfo  = writeRooms(out, level);
+    header.floors     = out.write(level.floors, level.floorsCount);
+
+// meshes, the first one is empty and used for unreferenced mesh pointers
+    Array<uint16> meshData(64 * 1024);
+    for (int i = 0; i < 5 + 6; i++)
+        meshData.push(0);
+
+    int32 *meshStart   = new int32[level.meshesCount];
+    int32 *meshOffsets = new int32[level.meshOffsetsCount];
+    for (int i = 0; i < level.meshesCount; i++) {
+        meshStart[i] = meshData.length * sizeof(uint16);
+        writeMesh(meshData, level.meshes[i]);
+    }
+    for (int i = 0; i < level.meshOffsetsCount; i++) {
+        int index = level.meshOffsets[i];
+        meshOffsets[i] = (index == -1) ? 0 : meshStart[index];
+    }
+    header.meshData    = out.write(meshData.items, meshData.length);
+    header.meshOffsets = out.write(meshOffsets, level.meshOffsetsCount);
+    delete[] meshStart;
+    delete[] meshOffsets;
+
+// animations
+    PKD::Anim *anims = new PKD::Anim[level.animsCount];
+    for (int i = 0; i < level.animsCount; i++) {
+        const TR::Animation &src = level.anims[i];
+        PKD::Anim &a = anims[i];
+        a.frameOffset    = src.frameOffset;
+        a.frameRate      = src.frameRate;
+        a.frameSize      = src.frameSize;
+        a.state          = src.state;
+        a.speed          = int32(src.speed.value);
+        a.accel          = int32(src.accel.value);
+        a.frameBegin     = src.frameStart;
+        a.frameEnd       = src.frameEnd;
+        a.nextAnimIndex  = src.nextAnimation;
+        a.nextFrameIndex = src.nextFrame;
+        a.statesCount    = src.scCount;
+        a.statesStart    = src.scOffset;
+        a.commandsCount  = src.acCount;
+        a.commandsStart  = src.animCommand;
+    }
+    header.anims = out.write(anims, level.animsCount);
+    delete[] anims;
+
+    PKD::AnimState *states = new PKD::AnimState[level.statesCount];
+    for (int i = 0; i < level.statesCount; i++) {
+        const TR::AnimState &src = level.states[i];
+        ASSERT(src.state < 256 && src.rangesCount < 256);
+        states[i].state       = uint8(src.state);
+        states[i].rangesCount = uint8(src.rangesCount);
+        states[i].rangesStart = src.rangesOffset;
+    }
+    header.animStates   = out.write(states, level.statesCount);
+    delete[] states;
+
+    header.animRanges   = out.write(level.ranges,    level.rangesCount);
+    header.animCommands = out.write(level.commands,  level.commandsCount);
+    header.nodes        = out.write(level.nodesData, level.nodesDataSize);
+    header.animFrames   = out.write(level.frameData, level.frameDataSize);
+
+// models and sprite sequences share one table indexed by the item type
+    PKD::Model models[PKD_MAX_MODELS];
+    memset(models, 0, sizeof(models));
+    for (int i = 0; i < level.modelsCount; i++) {
+        const TR::Model &src = level.models[i];
+        ASSERT(src.type < PKD_MAX_MODELS);
+        PKD::Model &m = models[src.type];
+        m.type      = uint8(src.type);
+        m.count     = int8(src.mCount);
+        m.start     = src.mStart;
+        m.nodeIndex = uint16(src.node / 4);
+        m.animIndex = src.animation;
+    }
+
+    PKD::SpriteSeq *spriteSeq = new PKD::SpriteSeq[level.spriteSequencesCount];
+    for (int i = 0; i < level.spriteSequencesCount; i++) {
+        const TR::SpriteSequence &src = level.spriteSequences[i];
+        PKD::SpriteSeq &s = spriteSeq[i];
+        s.type   = uint16(src.type);
+        s.unused = 0;
+        s.count  = -src.sCount;
+        s.start  = src.sStart;
+
+        if (src.type >= PKD_MAX_MODELS)
+            continue;
+
+        PKD::Model &m = models[src.type];
+        m.type  = uint8(src.type);
+        m.count = int8(s.count);
+        m.start = s.start;
+    }
+
+    header.modelsCount = PKD_MAX_MODELS;
+    header.models      = out.write(models, PKD_MAX_MODELS);
+
+// static meshes are indexed by id
+    PKD::StaticMesh staticMeshes[PKD_MAX_STATICS];
+    memset(staticMeshes, 0, sizeof(staticMeshes));
+    for (int i = 0; i < level.staticMeshesCount; i++) {
+        const TR::StaticMesh &src = level.staticMeshes[i];
+        ASSERT(src.id < PKD_MAX_STATICS);
+        PKD::StaticMesh &m = staticMeshes[src.id];
+        m.id        = uint16(src.id);
+        m.meshIndex = src.mesh;
+        m.flags     = src.flags;
+        memcpy(&m.vbox, &src.vbox, sizeof(m.vbox));
+        memcpy(&m.cbox, &src.cbox, sizeof(m.cbox));
+    }
+    header.staticMeshesCount = PKD_MAX_STATICS;
+    header.staticMeshes      = out.write(staticMeshes, PKD_MAX_STATICS);
+
+// textures
+    PKD::Texture *textures = new PKD::Texture[level.objectTexturesCount];
+    for (int i = 0; i < level.objectTexturesCount; i++) {
+        const TR::TextureInfo &src = level.objectTextures[i];
+        PKD::Texture &t = textures[i];
+        t.attribute = src.attribute;
+        t.tile      = src.tile;
+        for (int j = 0; j < 4; j++)
+            t.uv[j] = (uint32(src.texCoord[j].x) << 24) | (uint32(src.texCoord[j].y) << 8);
+    }
+    header.textures = out.write(textures, level.objectTexturesCount);
+    delete[] textures;
+
+    PKD::Sprite *sprites = new PKD::Sprite[level.spriteTexturesCount];
+    for (int i = 0; i < level.spriteTexturesCount; i++) {
+        const TR::TextureInfo &src = level.spriteTextures[i];
+        PKD::Sprite &s = sprites[i];
+        s.tile = src.tile;
+        s.u    = uint8(src.texCoord[0].x);
+        s.v    = uint8(src.texCoord[0].y);
+        s.w    = uint16(((src.texCoord[1].x - src.texCoord[0].x) << 8) | 0xFF);
+        s.h    = uint16(((src.texCoord[1].y - src.texCoord[0].y) << 8) | 0xFF);
+        s.l    = src.l;
+        s.t    = src.t;
+        s.r    = src.r;
+        s.b    = src.b;
+    }
+    header.sprites = out.write(sprites, level.spriteTexturesCount);
+    delete[] sprites;
+
+    header.spriteSequencesCount = level.spriteSequencesCount;
+    header.spriteSequences      = out.write(spriteSeq, level.spriteSequencesCount);
+    delete[] spriteSeq;
+
+// cameras & sound sources
+    header.cameras           = out.write(level.cameras, level.camerasCount);
+    header.soundSourcesCount = level.soundSourcesCount;
+    header.soundSources      = out.write(level.soundSources, level.soundSourcesCount);
+
+// boxes in sectors, overlaps and zones
+    PKD::Box *boxes = new PKD::Box[level.boxesCount];
+    for (int i = 0; i < level.boxesCount; i++) {
+        const TR::Box &src = level.boxes[i];
+        PKD::Box &b = boxes[i];
+        b.minZ    = int8(src.minZ >> 10);
+        b.maxZ    = int8((src.maxZ + 1) >> 10);
+        b.minX    = int8(src.minX >> 10);
+        b.maxX    = int8((src.maxX + 1) >> 10);
+        b.floor   = src.floor;
+        b.overlap = src.overlap.value;
+    }
+    header.boxesCount = level.boxesCount;
+    header.boxes      = out.write(boxes, level.boxesCount);
+    delete[] boxes;
+
+    header.overlaps = out.write(level.overlaps, level.overlapsCount);
+
+    for (int i = 0; i < 2; i++) {
+        header.zones[i][0] = out.write(level.zones[i].ground1, level.boxesCount);
+        header.zones[i][1] = out.write(level.zones[i].ground2, level.boxesCount);
+        header.zones[i][2] = out.write(level.zones[i].fly,     level.boxesCount);
+    }
+
+// animated textures in the original block layout
+    Array<uint16> animTex;
+    animTex.push(level.animTexturesCount);
+    for (int i = 0; i < level.animTexturesCount; i++) {
+        const TR::AnimTexture &src = level.animTextures[i];
+        animTex.push(src.count - 1);
+        for (int j = 0; j < src.count; j++)
+            animTex.push(src.textures[j]);
+    }
+    header.animTexDataSize = animTex.length;
+    header.animTexData     = out.write(animTex.items, animTex.length);
+
+// items, positions are relative to the room
+    PKD::ItemInfo *items = new PKD::ItemInfo[level.entitiesBaseCount];
+    for (int i = 0; i < level.entitiesBaseCount; i++) {
+        const TR::Entity &src = level.entities[i];
+        const TR::Room &room = level.rooms[src.room];
+        PKD::ItemInfo &item = items[i];
+        ASSERT(src.type < PKD_MAX_MODELS);
+        item.type      = uint8(src.type);
+        item.roomIndex = uint8(src.room);
+        item.pos       = short3(src.x - room.info.x, src.y, src.z - room.info.z);
+        item.intensity = src.intensity < 0 ? 0 : uint16(src.intensity >> 5); // 0 - use room lighting
+        item.flags     = (src.flags.value & 0x3FFF) | ((((src.rotation.value >> 14) + 2) & 3) << 14);
+    }
+    header.itemsCount = level.entitiesBaseCount;
+    header.itemsInfo  = out.write(items, level.entitiesBaseCount);
+    delete[] items;
+
+    header.cameraFramesCount = level.cameraFramesCount;
+    header.cameraFrames      = out.write(level.cameraFrames, level.cameraFramesCount);
+
+// sounds
+    header.soundMap = out.write(level.soundsMap, level.soundsCount);
+
+    PKD::SoundInfo *soundsInfo = new PKD::SoundInfo[level.soundsInfoCount];
+    for (int i = 0; i < level.soundsInfoCount; i++) {
+        const TR::SoundInfo &src = level.soundsInfo[i];
+        PKD::SoundInfo &s = soundsInfo[i];
+        s.index  = src.index;
+        s.volume = uint16(src.volume * 0x7FFF + 0.5f);
+        s.chance = uint16(src.chance * 0xFFFF + 0.5f);
+        s.flags  = src.flags.value;
+    }
+    header.soundsInfo = out.write(soundsInfo, level.soundsInfoCount);
+    delete[] soundsInfo;
+
+    header.soundData    = out.write(level.soundData,    level.soundDataSize);
+    header.soundOffsets = out.write(level.soundOffsets, level.soundOffsetsCount);
+
+    out.patch(0, &header, sizeof(header));
+
+    printf("%s -> %s (%d kb)\n", src, dst, out.tell() / 1024);
+
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const char *dir = NULL;
+    int failed = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            dir = argv[++i];
+            continue;
+        }
+
+        const char *src  = argv[i];
+        const char *name = strrchr(src, '/');
+        name = name ? name + 1 : src;
+
+        char dst[1024];
+        if (dir)
+            sprintf(dst, "%s/%s", dir, name);
+        else
+            strcpy(dst, src);
+
+        char *ext = strrchr(dst, '.');
+        if (ext && !strchr(ext, '/'))
+            strcpy(ext, ".PKD");
+        else
+            strcat(dst, ".PKD");
+
+        if (!pack(src, dst))
+            failed++;
+    }
+
+    if (argc < 2)
+        printf("usage: packer [-o output_dir] LEVEL1.PHD LEVEL2.PHD ...\n");
+
+    return failed ? 1 : 0;
+}
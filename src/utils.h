@@ -1690,6 +1690,12 @@ char saveDir[255];
 char contentDir[255];
 
 #define STREAM_BUFFER_SIZE (16 * 1024)
+#define STREAM_PRELOAD_SIZE (32 * 1024 * 1024) // async streams up to this size are read into memory by the I/O worker
+#define STREAM_PREFETCH_SIZE (64 * 1024 * 1024) // memory budget for prefetched files
+
+#ifndef STREAM_PACK_CACHE_SIZE
+    #define STREAM_PACK_CACHE_SIZE (8 * 1024 * 1024) // inflated pack entries kept for reopening, 0 to disable
+#endif
 
 #define MAX_PACKS 32
 
@@ -1707,80 +1713,150 @@ struct Stream {
     int         bufferIndex;
     bool        buffering;
     uint32      baseOffset;
+    uint32      packedSize; // deflate entry of a pack
+    bool        opened;
 
     struct Pack
     {
-        Stream* stream;
-        uint8*  table;
-        uint32  count;
+        struct Entry
+        {
+            uint32 hash;
+            uint16 method;
+            uint16 nameLen;
+            char*  name;
+            uint32 size;
+            uint32 packedSize;
+            uint32 header;      // local file header offset
+            uint32 offset;      // data offset, 0 until the local header is read
+            char*  cache;       // inflated data
+        };
 
         struct FileInfo
         {
             uint32 size;
             uint32 offset;
+            uint32 packedSize;  // 0 if stored
+            int32  index;
         };
 
-        bool findFile(const char* name, FileInfo &info)
+        Stream* stream;
+        uint8*  table;
+        uint32  count;
+        Entry*  entries;
+        int32*  buckets;        // open addressing hash table of entry indices
+        uint32  bucketsMask;
+
+        Array<int32> cached;    // inflated entries, least recently used first
+        int32   cacheSize;
+
+        static uint32 hashName(const char* name, int32 len)
         {
-            if (!table || !name || !name[0]) {
-                return false;
+            return fnv32(name, len);
+        }
+
+        int32 findEntry(const char* name)
+        {
+            if (!buckets || !name || !name[0]) {
+                return -1;
             }
 
-            uint16 len = (uint16)strlen(name);
-            uint8* ptr = table;
+            int32  len  = (int32)strlen(name);
+            uint32 hash = hashName(name, len);
 
-            for (uint32 i = 0; i < count; i++)
+            for (uint32 i = hash & bucketsMask; buckets[i] != -1; i = (i + 1) & bucketsMask)
             {
-                uint32 magic;
-                memcpy(&magic, ptr, sizeof(magic));
-                if (magic != 0x02014B50) {
-                    ASSERT(false);
-                    return false;
+                Entry &e = entries[buckets[i]];
+                if (e.hash == hash && e.nameLen == len && memcmp(e.name, name, len) == 0) {
+                    return buckets[i];
                 }
+            }
 
-                uint16 nameLen, extraLen, infoLen;
-                memcpy(&nameLen, ptr + 28, sizeof(nameLen));
-                memcpy(&extraLen, ptr + 30, sizeof(extraLen));
-
-                if ((nameLen == len) && (memcmp(ptr + 46, name, len) == 0))
-                {
-                    uint16 compression;
-                    memcpy(&compression, ptr + 10, sizeof(compression));
+            return -1;
+        }
 
-                    if (compression != 0)
-                    {
-                        ASSERT(false);
-                        return false;
-                    }
+        bool isSupported(int32 index) const
+        {
+            const Entry &e = entries[index];
+        #ifdef USE_INFLATE
+            return e.method == 0 || e.method == 8; // stored or deflate
+        #else
+            return e.method == 0;
+        #endif
+        }
 
-                    memcpy(&info.size,   ptr + 24, sizeof(info.size));
-                    memcpy(&info.offset, ptr + 42, sizeof(info.offset));
+        bool findFile(const char* name, FileInfo &info)
+        {
+            int32 index = findEntry(name);
+            if (index == -1) {
+                return false;
+            }
 
-                    stream->setPos(info.offset);
-                    magic = stream->readLE32();
+            Entry &e = entries[index];
 
-                    if (magic != 0x04034B50) {
-                        ASSERT(false);
-                        return false;
-                    }
-                    stream->seek(22);
-                    nameLen = stream->readLE16();
-                    extraLen = stream->readLE16();
+            if (!isSupported(index))
+            {
+                ASSERT(false);
+                return false;
+            }
 
-                    info.offset += 4 + 22 + 2 + 2 + nameLen + extraLen; 
+            if (!e.offset)
+            {
+                stream->setPos(e.header);
+                uint32 magic = stream->readLE32();
 
-                    return true;
+                if (magic != 0x04034B50) {
+                    ASSERT(false);
+                    return false;
                 }
+                stream->seek(22);
+                uint16 nameLen  = stream->readLE16();
+                uint16 extraLen = stream->readLE16();
 
-                memcpy(&infoLen,  ptr + 32, sizeof(infoLen));
+                e.offset = e.header + 4 + 22 + 2 + 2 + nameLen + extraLen;
+            }
 
-                ptr += 46 + nameLen + extraLen + infoLen;
+            info.size       = e.size;
+            info.offset     = e.offset;
+            info.packedSize = e.method ? e.packedSize : 0;
+            info.index      = index;
+
+            return true;
+        }
+
+        char* cacheGet(int32 index)
+        {
+            int32 i = cached.find(index);
+            if (i == -1) {
+                return NULL;
             }
+            cached.remove(i);
+            cached.push(index);
+            return entries[index].cache;
+        }
 
-            return false;
+        void cachePut(int32 index, const char* data, int32 size)
+        {
+            if (size > STREAM_PACK_CACHE_SIZE / 4 || entries[index].cache) {
+                return;
+            }
+
+            while (cacheSize + size > STREAM_PACK_CACHE_SIZE)
+            {
+                Entry &e = entries[cached[0]];
+                cacheSize -= e.size;
+                delete[] e.cache;
+                e.cache = NULL;
+                cached.remove(0);
+            }
+
+            Entry &e = entries[index];
+            e.cache = new char[size];
+            memcpy(e.cache, data, size);
+            cached.push(index);
+            cacheSize += size;
         }
 
-        Pack(const char *name) : stream(NULL), table(NULL), count(0)
+        Pack(const char *name) : stream(NULL), table(NULL), count(0), entries(NULL), buckets(NULL), bucketsMask(0), cacheSize(0)
         {
             stream = new Stream(name);
             stream->buffering = false;
@@ -1802,11 +1878,63 @@ struct Stream {
 
             table = new uint8[tableSize];
             stream->raw(table, tableSize);
+
+        // parse the central directory once, names point into the table
+            uint32 bucketsCount = 16;
+            while (bucketsCount < count * 2) {
+                bucketsCount <<= 1;
+            }
+            bucketsMask = bucketsCount - 1;
+
+            entries = new Entry[count];
+            buckets = new int32[bucketsCount];
+            memset(buckets, 0xFF, sizeof(int32) * bucketsCount);
+
+            uint8* ptr = table;
+
+            for (uint32 i = 0; i < count; i++)
+            {
+                memcpy(&magic, ptr, sizeof(magic));
+                if (magic != 0x02014B50) {
+                    ASSERT(false);
+                    count = i;
+                    break;
+                }
+
+                uint16 nameLen, extraLen, infoLen;
+                memcpy(&nameLen,  ptr + 28, sizeof(nameLen));
+                memcpy(&extraLen, ptr + 30, sizeof(extraLen));
+                memcpy(&infoLen,  ptr + 32, sizeof(infoLen));
+
+                Entry &e = entries[i];
+                memcpy(&e.method,     ptr + 10, sizeof(e.method));
+                memcpy(&e.packedSize, ptr + 20, sizeof(e.packedSize));
+                memcpy(&e.size,       ptr + 24, sizeof(e.size));
+                memcpy(&e.header,     ptr + 42, sizeof(e.header));
+                e.name    = (char*)ptr + 46;
+                e.nameLen = nameLen;
+                e.hash    = hashName(e.name, nameLen);
+                e.offset  = 0;
+                e.cache   = NULL;
+
+                uint32 b = e.hash & bucketsMask;
+                while (buckets[b] != -1) {
+                    b = (b + 1) & bucketsMask;
+                }
+                buckets[b] = i;
+
+                ptr += 46 + nameLen + extraLen + infoLen;
+            }
         }
 
         ~Pack() {
+            for (int i = 0; i < cached.length; i++) {
+                delete[] entries[cached[i]].cache;
+            }
             delete stream;
             delete[] table;
+            delete[] entries;
+            delete[] buckets;
         }
     };
 
@@ -1814,6 +1942,11 @@ struct Stream {
 
     static Array<char*> fileList;
 
+    static Array<Stream*> pending; // async streams waiting for the I/O worker
+
+    static Array<Stream*> prefetched;
+    static int prefetchedSize;
+
     static bool addPack(const char *name)
     {
         if (!existsContent(name)) {
@@ -1847,6 +1980,8 @@ struct Stream {
             delete[] fileList[i];
         }
         fileList.clear();
+
+        prefetchClear();
     }
 
 private:
@@ -1857,7 +1992,7 @@ private:
     }
 #endif
 
-    void openFile() {
+    bool open() {
         char path[255];
 
         path[0] = 0;
@@ -1868,8 +2003,73 @@ private:
         fixBackslash(path);
 
         f = fopen(path, "rb");
+        if (!f)
+            return false;
+
+        fseek(f, 0, SEEK_END);
+        size = (int32)ftell(f);
+        fseek(f, 0, SEEK_SET);
+
+        fpos = 0;
+        bufferIndex = -1;
+        return true;
+    }
+
+    void packCachePut() {
+        for (int i = 0; i < MAX_PACKS; i++)
+        {
+            if (!packs[i]) break;
+
+            int32 index = packs[i]->findEntry(name);
+            if (index != -1) {
+                packs[i]->cachePut(index, data, size);
+                return;
+            }
+        }
+    }
+
+    void inflate() {
+    #ifdef USE_INFLATE
+        char *packed = new char[packedSize];
+        fseek(f, baseOffset, SEEK_SET);
+        int readed = (int)fread(packed, 1, packedSize, f);
+        fclose(f);
+        f = NULL;
+
+        buffer = new char[max(size, 1)];
+        uint32 len = 0;
+        if (readed != int(packedSize) || tinf_uncompress_limit(buffer, &len, max(size, 1), packed, packedSize) != TINF_OK || int(len) != size) {
+            LOG("error inflating file \"%s\"\n", name);
+            delete[] buffer;
+            buffer = NULL;
+        }
+        delete[] packed;
+
+        data = buffer; // owned by buffer
+    #endif
+    }
+
+    void preload() {
+        if (f && packedSize) {
+            inflate();
+            return;
+        }
 
-        if (!f) {
+        if (!f || size > STREAM_PRELOAD_SIZE)
+            return;
+
+        buffer = new char[max(size, 1)];
+        fseek(f, baseOffset, SEEK_SET);
+        int readed = (int)fread(buffer, 1, size, f);
+        ASSERT(readed == size);
+        fclose(f);
+        f    = NULL;
+        data = buffer; // owned by buffer
+        size = readed;
+    }
+
+    void complete() {
+        if (!f && !data) {
             #ifdef _OS_WEB
                 osDownload(this);
             #else
@@ -1882,23 +2082,99 @@ private:
                 }
             #endif
         } else {
-            fseek(f, 0, SEEK_END);
-            size = (int32)ftell(f);
-            fseek(f, 0, SEEK_SET);
+            if (packedSize && data) {
+                packCachePut();
+            }
+            if (callback) callback(this, userData);
+        }
+    }
 
-            fpos = 0;
-            bufferIndex = -1;
+    void openFile() {
+        open();
+        complete();
+    }
 
-            if (callback) callback(this, userData);
+    static void ioProcess(void *userData) {
+        Stream *stream = (Stream*)userData;
+        if (stream->opened || stream->open()) {
+            stream->preload();
         }
     }
+
+    static void ioComplete(void *userData) {
+        Stream *stream = (Stream*)userData;
+        pending.remove(pending.find(stream));
+
+        if (!stream->callback) { // canceled
+            delete stream;
+            return;
+        }
+        stream->complete();
+    }
+
+    bool openAsync(); // queues ioProcess on the I/O worker, core.h
+
+    static int findPrefetched(const char *name) {
+        for (int i = 0; i < prefetched.length; i++) {
+            if (strcmp(prefetched[i]->name, name) == 0) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    bool takePrefetched(const char *name) {
+        int index = findPrefetched(name);
+        if (index == -1)
+            return false;
+
+        Stream *stream = prefetched[index];
+        prefetched.removeFast(index);
+        prefetchedSize -= stream->size;
+
+        data   = buffer = stream->buffer;
+        size   = stream->size;
+        stream->buffer = NULL;
+        delete stream;
+
+        this->name = StrUtils::copy(name);
+        return true;
+    }
 public:
+    static bool isAsync(); // core.h
+
+    static void prefetchLoaded(Stream *stream, void *userData) {
+        if (!stream) return;
+
+        if (!stream->data || !stream->buffer || prefetchedSize + stream->size > STREAM_PREFETCH_SIZE || findPrefetched(stream->name) != -1) {
+            delete stream;
+            return;
+        }
 
-    Stream(const char *name, const void *data, int size, Callback *callback = NULL, void *userData = NULL) : callback(callback), userData(userData), f(NULL), data((char*)data), name(NULL), size(size), pos(0), buffer(NULL) {
+        prefetched.push(stream);
+        prefetchedSize += stream->size;
+    }
+
+    // reads the file into memory in background, the next Stream of this file doesn't touch the disk
+    static void prefetch(const char *name) {
+        if (!name || !isAsync() || findPrefetched(name) != -1)
+            return;
+        new Stream(name, prefetchLoaded, NULL);
+    }
+
+    static void prefetchClear() {
+        for (int i = 0; i < prefetched.length; i++) {
+            delete prefetched[i];
+        }
+        prefetched.clear();
+        prefetchedSize = 0;
+    }
+
+    Stream(const char *name, const void *data, int size, Callback *callback = NULL, void *userData = NULL) : callback(callback), userData(userData), f(NULL), data((char*)data), name(NULL), size(size), pos(0), buffer(NULL), packedSize(0), opened(false) {
         this->name = StrUtils::copy(name);
     }
 
-    Stream(const char *name, Callback *callback = NULL, void *userData = NULL) : callback(callback), userData(userData), f(NULL), data(NULL), name(NULL), size(-1), pos(0), buffer(NULL), buffering(true), baseOffset(0) {
+    Stream(const char *name, Callback *callback = NULL, void *userData = NULL) : callback(callback), userData(userData), f(NULL), data(NULL), name(NULL), size(-1), pos(0), buffer(NULL), buffering(true), baseOffset(0), packedSize(0), opened(false) {
         if (!name && callback) {
             callback(NULL, userData);
             delete this;
@@ -1909,6 +2185,11 @@ public:
             ASSERT(false);
         }
 
+        if (takePrefetched(name)) {
+            if (callback) callback(this, userData);
+            return;
+        }
+
         Stream::Pack::FileInfo info;
 
         char path[256];
@@ -1919,6 +2200,17 @@ public:
 
             if (packs[i]->findFile(name, info))
             {
+                this->name = StrUtils::copy(name);
+                size = info.size;
+
+                char *cache = info.packedSize ? packs[i]->cacheGet(info.index) : NULL;
+                if (cache) {
+                    data = buffer = new char[max(size, 1)];
+                    memcpy(buffer, cache, size);
+                    if (callback) callback(this, userData);
+                    return;
+                }
+
                 path[0] = 0;
                 if (contentDir[0] && (!cacheDir[0] || !strstr(name, cacheDir))) {
                     strcpy(path, contentDir);
@@ -1933,14 +2225,20 @@ public:
                     return;
                 }
                 baseOffset = info.offset;
+                packedSize = info.packedSize;
                 fseek(f, info.offset, SEEK_SET);
-                size = info.size;
 
                 fpos = 0;
                 bufferIndex = -1;
 
-                this->name = StrUtils::copy(name);
-                if (callback) callback(this, userData);
+                opened = true;
+                if (callback && openAsync())
+                    return;
+
+                if (packedSize) {
+                    inflate();
+                }
+                complete();
                 return;
             }
         }
@@ -1956,9 +2254,21 @@ public:
         }*/
     #endif
 
+        if (callback && openAsync())
+            return;
+
         openFile();
     }
 
+    // the callback of pending streams with this userData will not be called
+    static void cancel(void *userData) {
+        for (int i = 0; i < pending.length; i++) {
+            if (pending[i]->userData == userData) {
+                pending[i]->callback = NULL;
+            }
+        }
+    }
+
     ~Stream() {
         delete[] name;
         delete[] buffer;
@@ -2096,8 +2406,8 @@ public:
         {
             if (!packs[i]) break;
 
-            Pack::FileInfo info;
-            if (packs[i]->findFile(name, info))
+            int32 index = packs[i]->findEntry(name);
+            if (index != -1 && packs[i]->isSupported(index))
                 return true;
         }
 
@@ -2268,6 +2578,9 @@ public:
 
 Stream::Pack* Stream::packs[MAX_PACKS];
 Array<char*> Stream::fileList;
+Array<Stream*> Stream::pending;
+Array<Stream*> Stream::prefetched;
+int Stream::prefetchedSize;
 
 #ifdef OS_FILEIO_CACHE
 void osDataWrite(Stream *stream, const char *dir) {
@@ -2380,6 +2693,77 @@ void osRWLockWrite(void *obj) {
 void osRWUnlockWrite(void *obj) {
     pthread_rwlock_unlock((pthread_rwlock_t*)obj);
 }
+
+struct ThreadParams {
+    void (*proc)(void *arg);
+    void *arg;
+};
+
+void* osThreadProc(void *arg) {
+    ThreadParams params = *(ThreadParams*)arg;
+    delete (ThreadParams*)arg;
+    params.proc(params.arg);
+    return NULL;
+}
+
+void* osThreadCreate(void (*proc)(void *arg), void *arg) {
+    ThreadParams *params = new ThreadParams();
+    params->proc = proc;
+    params->arg  = arg;
+
+    pthread_t *thread = new pthread_t();
+    if (pthread_create(thread, NULL, osThreadProc, params) != 0) {
+        delete params;
+        delete thread;
+        return NULL;
+    }
+    return thread;
+}
+
+void osThreadJoin(void *obj) {
+    pthread_join(*(pthread_t*)obj, NULL);
+    delete (pthread_t*)obj;
+}
+
+// unnamed POSIX semaphores are not supported by OSX
+struct Sema {
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    int             count;
+};
+
+void* osSemaInit(int count) {
+    Sema *sema = new Sema();
+    pthread_mutex_init(&sema->mutex, NULL);
+    pthread_cond_init(&sema->cond, NULL);
+    sema->count = count;
+    return sema;
+}
+
+void osSemaFree(void *obj) {
+    Sema *sema = (Sema*)obj;
+    pthread_cond_destroy(&sema->cond);
+    pthread_mutex_destroy(&sema->mutex);
+    delete sema;
+}
+
+void osSemaWait(void *obj) {
+    Sema *sema = (Sema*)obj;
+    pthread_mutex_lock(&sema->mutex);
+    while (sema->count <= 0) {
+        pthread_cond_wait(&sema->cond, &sema->mutex);
+    }
+    sema->count--;
+    pthread_mutex_unlock(&sema->mutex);
+}
+
+void osSemaPost(void *obj) {
+    Sema *sema = (Sema*)obj;
+    pthread_mutex_lock(&sema->mutex);
+    sema->count++;
+    pthread_cond_signal(&sema->cond);
+    pthread_mutex_unlock(&sema->mutex);
+}
 #endif
 
 
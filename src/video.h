@@ -9,6 +9,21 @@
     #define NO_VIDEO
 #endif
 
+// SIMD path for PSX STR decoder (bit-exact with the scalar one)
+#ifndef VIDEO_NO_SIMD
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define VIDEO_SIMD_SSE2
+        #include <emmintrin.h>
+    #elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+        #define VIDEO_SIMD_NEON
+        #include <arm_neon.h>
+    #endif
+
+    #if defined(VIDEO_SIMD_SSE2) || defined(VIDEO_SIMD_NEON)
+        #define VIDEO_SIMD
+    #endif
+#endif
+
 struct AC_ENTRY {
     uint8 code;
     uint8 skip;
@@ -736,6 +751,7 @@ struct Video {
             AUDIO_SECTOR_SIZE = (16 + 112) * 18, // XA ADPCM data block size
 
             MAX_CHUNKS        = 4,
+            MAX_AUDIO_CHUNKS  = 32, // ~1 of 8 sectors is audio, covers the frames decoded ahead with a wide margin
         };
 
         struct SyncHeader {
@@ -785,7 +801,7 @@ struct Video {
         uint8 AC_LUT_9[256];
 
         VideoChunk videoChunks[MAX_CHUNKS];
-        AudioChunk audioChunks[MAX_CHUNKS];
+        AudioChunk audioChunks[MAX_AUDIO_CHUNKS];
 
         int   videoChunksCount;
         int   audioChunksCount;
@@ -926,7 +942,12 @@ struct Video {
                     }
 
                 } else {
-                    AudioChunk *chunk = audioChunks + (audioChunksCount++ % MAX_CHUNKS);
+                    if (audioChunksCount - curAudioChunk > int(MAX_AUDIO_CHUNKS)) // ring is full (or audio is played from a separate track), drop the oldest sector
+                    {
+                        curAudioChunk++;
+                    }
+
+                    AudioChunk *chunk = audioChunks + (audioChunksCount++ % MAX_AUDIO_CHUNKS);
 
                     memcpy(chunk->data, &sector, sizeof(sector)); // audio chunk has no sector header (just XA data)
                     stream->raw(chunk->data + sizeof(sector), AUDIO_SECTOR_SIZE - sizeof(sector)); // !!! MUST BE 2304 !!! most of CD image tools copy only 2048 per sector, so "clicks" will be there
@@ -1069,6 +1090,11 @@ struct Video {
                 return;
             }
 
+        #ifdef VIDEO_SIMD
+            IDCT_SIMD(block);
+            return;
+        #endif
+
             ptr = block;
             for (i = 0; i < 8; i++, ptr++)
             {
@@ -1158,6 +1184,208 @@ struct Video {
             }
         }
 
+    #if defined(VIDEO_SIMD_SSE2)
+        typedef __m128i simd4i;
+
+        static inline simd4i simdLoad(const int32 *p)            { return _mm_loadu_si128((const __m128i*)p); }
+        static inline void   simdStore(int32 *p, simd4i a)       { _mm_storeu_si128((__m128i*)p, a); }
+        static inline simd4i simdAdd(simd4i a, simd4i b)         { return _mm_add_epi32(a, b); }
+        static inline simd4i simdSub(simd4i a, simd4i b)         { return _mm_sub_epi32(a, b); }
+        static inline simd4i simdShr12(simd4i a)                 { return _mm_srai_epi32(a, AAN_CONST_BITS); }
+
+        static inline simd4i simdMul(simd4i a, int32 b) { // no pmulld in SSE2, low 32 bits are the same for signed and unsigned
+            __m128i m    = _mm_set1_epi32(b);
+            __m128i even = _mm_mul_epu32(a, m);
+            __m128i odd  = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);
+            return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+        }
+
+        static inline void simdTranspose(const simd4i *a, simd4i *b) {
+            __m128i t0 = _mm_unpacklo_epi32(a[0], a[1]);
+            __m128i t1 = _mm_unpacklo_epi32(a[2], a[3]);
+            __m128i t2 = _mm_unpackhi_epi32(a[0], a[1]);
+            __m128i t3 = _mm_unpackhi_epi32(a[2], a[3]);
+            b[0] = _mm_unpacklo_epi64(t0, t1);
+            b[1] = _mm_unpackhi_epi64(t0, t1);
+            b[2] = _mm_unpacklo_epi64(t2, t3);
+            b[3] = _mm_unpackhi_epi64(t2, t3);
+        }
+    #elif defined(VIDEO_SIMD_NEON)
+        typedef int32x4_t simd4i;
+
+        static inline simd4i simdLoad(const int32 *p)            { return vld1q_s32(p); }
+        static inline void   simdStore(int32 *p, simd4i a)       { vst1q_s32(p, a); }
+        static inline simd4i simdAdd(simd4i a, simd4i b)         { return vaddq_s32(a, b); }
+        static inline simd4i simdSub(simd4i a, simd4i b)         { return vsubq_s32(a, b); }
+        static inline simd4i simdShr12(simd4i a)                 { return vshrq_n_s32(a, AAN_CONST_BITS); }
+        static inline simd4i simdMul(simd4i a, int32 b)          { return vmulq_n_s32(a, b); }
+
+        static inline void simdTranspose(const simd4i *a, simd4i *b) {
+            int32x4x2_t p0 = vtrnq_s32(a[0], a[1]);
+            int32x4x2_t p1 = vtrnq_s32(a[2], a[3]);
+            b[0] = vcombine_s32(vget_low_s32(p0.val[0]),  vget_low_s32(p1.val[0]));
+            b[1] = vcombine_s32(vget_low_s32(p0.val[1]),  vget_low_s32(p1.val[1]));
+            b[2] = vcombine_s32(vget_high_s32(p0.val[0]), vget_high_s32(p1.val[0]));
+            b[3] = vcombine_s32(vget_high_s32(p0.val[1]), vget_high_s32(p1.val[1]));
+        }
+    #endif
+
+    #ifdef VIDEO_SIMD
+        // the same AAN butterfly as IDCT, but for 4 columns at once
+        static inline void IDCT_SIMD_Pass(simd4i *v)
+        {
+            simd4i tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+            simd4i z5, z10, z11, z12, z13;
+
+            z10 = simdAdd(v[0], v[4]);
+            z11 = simdSub(v[0], v[4]);
+            z13 = simdAdd(v[2], v[6]);
+            z12 = simdSub(simdShr12(simdMul(simdSub(v[2], v[6]), FIX_1_414213562)), z13);
+
+            tmp0 = simdAdd(z10, z13);
+            tmp3 = simdSub(z10, z13);
+            tmp1 = simdAdd(z11, z12);
+            tmp2 = simdSub(z11, z12);
+
+            z13 = simdAdd(v[3], v[5]);
+            z10 = simdSub(v[3], v[5]);
+            z11 = simdAdd(v[1], v[7]);
+            z12 = simdSub(v[1], v[7]);
+
+            tmp7 = simdAdd(z11, z13);
+
+            z5   = simdMul(simdSub(z12, z10), FIX_1_847759065);
+            tmp6 = simdSub(simdShr12(simdAdd(simdMul(z10, FIX_2_613125930), z5)), tmp7);
+            tmp5 = simdSub(simdShr12(simdMul(simdSub(z11, z13), FIX_1_414213562)), tmp6);
+            tmp4 = simdAdd(simdShr12(simdSub(simdMul(z12, FIX_1_082392200), z5)), tmp5);
+
+            v[0] = simdAdd(tmp0, tmp7);
+            v[7] = simdSub(tmp0, tmp7);
+            v[1] = simdAdd(tmp1, tmp6);
+            v[6] = simdSub(tmp1, tmp6);
+            v[2] = simdAdd(tmp2, tmp5);
+            v[5] = simdSub(tmp2, tmp5);
+            v[4] = simdAdd(tmp3, tmp4);
+            v[3] = simdSub(tmp3, tmp4);
+        }
+
+        static inline void IDCT_SIMD_Transpose(simd4i (*src)[8], simd4i (*dst)[8])
+        {
+            for (int r = 0; r < 2; r++)
+            {
+                for (int c = 0; c < 2; c++)
+                {
+                    simdTranspose(src[c] + r * 4, dst[r] + c * 4);
+                }
+            }
+        }
+
+        // the column and row passes are done in full, the scalar used_col shortcuts give the same result
+        static void IDCT_SIMD(int32 *block)
+        {
+            simd4i a[2][8], b[2][8]; // [4 columns half][row]
+
+            for (int i = 0; i < 8; i++)
+            {
+                a[0][i] = simdLoad(block + i * 8);
+                a[1][i] = simdLoad(block + i * 8 + 4);
+            }
+
+            IDCT_SIMD_Pass(a[0]);
+            IDCT_SIMD_Pass(a[1]);
+
+            IDCT_SIMD_Transpose(a, b);
+
+            IDCT_SIMD_Pass(b[0]);
+            IDCT_SIMD_Pass(b[1]);
+
+            IDCT_SIMD_Transpose(b, a);
+
+            for (int i = 0; i < 8; i++)
+            {
+                simdStore(block + i * 8,     a[0][i]);
+                simdStore(block + i * 8 + 4, a[1][i]);
+            }
+        }
+
+        // 8 pixels of the row, Cr and Cb are shared by the pixel pairs
+        static inline void putRowRGBA(Color32 *dst, const int32 *Yblk, const int32 *Crblk, const int32 *Cbblk)
+        {
+        #if defined(VIDEO_SIMD_SSE2)
+            __m128i Cr = simdLoad(Crblk);
+            __m128i Cb = simdLoad(Cbblk);
+            __m128i c[3][2];
+
+            for (int k = 0; k < 2; k++)
+            {
+                __m128i cr = k ? _mm_unpackhi_epi32(Cr, Cr) : _mm_unpacklo_epi32(Cr, Cr);
+                __m128i cb = k ? _mm_unpackhi_epi32(Cb, Cb) : _mm_unpacklo_epi32(Cb, Cb);
+                __m128i Y  = _mm_slli_epi32(simdLoad(Yblk + k * 4), 10);
+
+                __m128i R = simdMul(cr, 1434);
+                __m128i G = simdAdd(simdMul(cb, -351), simdMul(cr, -728));
+                __m128i B = simdMul(cb, 1807);
+
+                const __m128i round = _mm_set1_epi32(1 << 19);
+                const __m128i bias  = _mm_set1_epi32(128);
+
+                c[0][k] = simdAdd(_mm_srai_epi32(simdAdd(simdAdd(Y, R), round), 20), bias);
+                c[1][k] = simdAdd(_mm_srai_epi32(simdAdd(simdAdd(Y, G), round), 20), bias);
+                c[2][k] = simdAdd(_mm_srai_epi32(simdAdd(simdAdd(Y, B), round), 20), bias);
+            }
+
+            __m128i RG = _mm_packus_epi16(_mm_packs_epi32(c[0][0], c[0][1]), _mm_packs_epi32(c[1][0], c[1][1]));
+            __m128i BA = _mm_packus_epi16(_mm_packs_epi32(c[2][0], c[2][1]), _mm_set1_epi16(255));
+
+            RG = _mm_unpacklo_epi8(RG, _mm_srli_si128(RG, 8));
+            BA = _mm_unpacklo_epi8(BA, _mm_srli_si128(BA, 8));
+
+            _mm_storeu_si128((__m128i*)(dst + 0), _mm_unpacklo_epi16(RG, BA));
+            _mm_storeu_si128((__m128i*)(dst + 4), _mm_unpackhi_epi16(RG, BA));
+        #elif defined(VIDEO_SIMD_NEON)
+            int32x4x2_t Cr = vzipq_s32(vld1q_s32(Crblk), vld1q_s32(Crblk));
+            int32x4x2_t Cb = vzipq_s32(vld1q_s32(Cbblk), vld1q_s32(Cbblk));
+            int16x4_t c[3][2];
+
+            for (int k = 0; k < 2; k++)
+            {
+                int32x4_t Y = vshlq_n_s32(vld1q_s32(Yblk + k * 4), 10);
+
+                int32x4_t R = vmulq_n_s32(Cr.val[k], 1434);
+                int32x4_t G = vaddq_s32(vmulq_n_s32(Cb.val[k], -351), vmulq_n_s32(Cr.val[k], -728));
+                int32x4_t B = vmulq_n_s32(Cb.val[k], 1807);
+
+                const int32x4_t round = vdupq_n_s32(1 << 19);
+                const int32x4_t bias  = vdupq_n_s32(128);
+
+                c[0][k] = vqmovn_s32(vaddq_s32(vshrq_n_s32(vaddq_s32(vaddq_s32(Y, R), round), 20), bias));
+                c[1][k] = vqmovn_s32(vaddq_s32(vshrq_n_s32(vaddq_s32(vaddq_s32(Y, G), round), 20), bias));
+                c[2][k] = vqmovn_s32(vaddq_s32(vshrq_n_s32(vaddq_s32(vaddq_s32(Y, B), round), 20), bias));
+            }
+
+            uint8x8x4_t pix;
+            pix.val[0] = vqmovun_s16(vcombine_s16(c[0][0], c[0][1]));
+            pix.val[1] = vqmovun_s16(vcombine_s16(c[1][0], c[1][1]));
+            pix.val[2] = vqmovun_s16(vcombine_s16(c[2][0], c[2][1]));
+            pix.val[3] = vdup_n_u8(255);
+            vst4_u8((uint8*)dst, pix);
+        #endif
+        }
+
+        static void YUV2RGBA(int32 *blk, Color32 *image, int pitch)
+        {
+            for (int y = 0; y < 16; y++, image += pitch)
+            {
+                int32 *Yblk  = blk + 64 * 2 + ((y & 8) << 4) + (y & 7) * 8; // YTL or YBL
+                int32 *Crblk = blk + (y >> 1) * 8;
+                int32 *Cbblk = blk + (y >> 1) * 8 + 64;
+
+                putRowRGBA(image + 0, Yblk,      Crblk + 0, Cbblk + 0);
+                putRowRGBA(image + 8, Yblk + 64, Crblk + 4, Cbblk + 4); // YTR or YBR
+            }
+        }
+    #endif
+
         static inline void putQuadRGB24(uint8 *image, int *Yblk, int Cr, int Cb)
         {
             int Y, R, G, B;
@@ -1219,6 +1447,12 @@ struct Video {
 
             int32 qscale = chunk->qscale;
 
+            int32 qtable[64]; // dequantization table for the frame
+            for (int i = 0; i < 64; i++)
+            {
+                qtable[i] = STR_QTABLE[i] * qscale;
+            }
+
             int32 blocks[64 * 6]; // Cr, Cb, YTL, YTR, YBL, YBR
             for (int32 bX = 0; bX < width / 16; bX++)
             {
@@ -1245,7 +1479,7 @@ struct Video {
                         {
                             index += skip + 1;
                             ASSERT(index < 64);
-                            block[STR_ZSCAN[index]] = SCALER(ac * STR_QTABLE[index] * qscale, AAN_EXTRA);
+                            block[STR_ZSCAN[index]] = SCALER(ac * qtable[index], AAN_EXTRA);
 
                             used_col |= (STR_ZSCAN[index] > 7) ? 1 << (STR_ZSCAN[index] & 7) : 0;
                         }
@@ -1255,11 +1489,15 @@ struct Video {
                         IDCT(block, used_col);
                     }
 
+                    Color32 *blockPixels = pixels + (width * bY * 16 + bX * 16);
+
+                #ifdef VIDEO_SIMD
+                    YUV2RGBA(blocks, blockPixels, width);
+                #else
                     Color24 pix[16 * 16];
                     YUV2RGB24(blocks, (uint8*)pix);
 
                     int32 i = 0;
-                    Color32 *blockPixels = pixels + (width * bY * 16 + bX * 16);
                     for (int y = 0; y < 16; y++)
                     {
                         for (int x = 0; x < 16; x++)
@@ -1267,6 +1505,7 @@ struct Video {
                             blockPixels[y * width + x] = pix[i++];
                         }
                     }
+                #endif
                 }
             }
 
@@ -1287,7 +1526,7 @@ struct Video {
                 }
             }
 
-            AudioChunk *chunk = audioChunks + (curAudioChunk % MAX_CHUNKS);
+            AudioChunk *chunk = audioChunks + (curAudioChunk % MAX_AUDIO_CHUNKS);
             ASSERT(chunk->size > 0);
             audioDecoder->processSector(chunk->data);
             return true;
@@ -1470,14 +1709,26 @@ struct Video {
         SAT,
     } format;
 
+    enum {
+        FRAME_QUEUE = 3, // decoded frames ahead of presentation
+    };
+
     Sound::Sample *sample;
     Decoder *decoder;
     Texture *frameTex[2];
-    Color32 *frameData;
-    float   step, stepTimer, time;
+    Color32 *frameData[FRAME_QUEUE];
+    float   step, stepTimer, time, audioFreq;
     bool    isPlaying;
     bool    needUpdate;
 
+// frames ring is filled by decodeThread and consumed by update/render
+    Core::Thread    thread;
+    Core::Semaphore freeFrames;
+    Core::Mutex     frameLock;
+    int     queueHead, queueTail;
+    int     frameIndex;
+    bool    isThreaded, isDecoded, isQuit;
+
     static void playAsync(Stream *stream, void *userData) {
         if (stream) {
             Video *video = (Video*)userData;
@@ -1486,8 +1737,24 @@ struct Video {
         }
     }
 
-    Video(Stream *stream, TR::LevelID id) : sample(NULL), decoder(NULL), stepTimer(0.0f), time(0.0f), isPlaying(false), needUpdate(false) {
+    static void decodeThread(void *arg) {
+        Video *video = (Video*)arg;
+        while (1) {
+            video->freeFrames.wait();
+            {
+                OS_LOCK(video->frameLock);
+                if (video->isQuit)
+                    break;
+            }
+            if (!video->decodeFrame())
+                break;
+        }
+    }
+
+    Video(Stream *stream, TR::LevelID id) : sample(NULL), decoder(NULL), stepTimer(0.0f), time(0.0f), audioFreq(44100.0f), isPlaying(false), needUpdate(false),
+                                            freeFrames(FRAME_QUEUE), queueHead(0), queueTail(0), frameIndex(0), isThreaded(false), isDecoded(false), isQuit(false) {
         frameTex[0] = frameTex[1] = NULL;
+        memset(frameData, 0, sizeof(frameData));
 
         if (!stream) return;
 
@@ -1508,16 +1775,17 @@ struct Video {
             decoder = new STR(stream);
         }
 
-        frameData = new Color32[decoder->width * decoder->height];
-        memset(frameData, 0, decoder->width * decoder->height * sizeof(Color32));
+        for (int i = 0; i < FRAME_QUEUE; i++) {
+            frameData[i] = new Color32[decoder->width * decoder->height];
+            memset(frameData[i], 0, decoder->width * decoder->height * sizeof(Color32));
+        }
 
         for (int i = 0; i < 2; i++) {
-            frameTex[i] = new Texture(decoder->width, decoder->height, 1, FMT_RGBA, OPT_DYNAMIC, frameData);
+            frameTex[i] = new Texture(decoder->width, decoder->height, 1, FMT_RGBA, OPT_DYNAMIC, frameData[0]);
         }
 
         if (!TR::getVideoTrack(id, playAsync, this)) {
             sample = Sound::play(decoder);
-            sample->pitch = pitch;
             if (sample) {
                 sample->pitch = pitch;
             }
@@ -1526,10 +1794,24 @@ struct Video {
         step      = 1.0f / decoder->fps;
         stepTimer = step;
         time      = 0.0f;
+        audioFreq = 44100.0f * pitch;
         isPlaying = true;
+
+    #ifndef VIDEO_TEST
+        isThreaded = thread.start(decodeThread, this);
+    #endif
     }
 
     virtual ~Video() {
+        Stream::cancel(this); // the audio track of getVideoTrack may still be loading
+
+        {
+            OS_LOCK(frameLock);
+            isQuit = true;
+        }
+        freeFrames.post();
+        thread.join();
+
         OS_LOCK(Sound::lock);
         if (sample) {
             if (sample->decoder == decoder) {
@@ -1540,32 +1822,103 @@ struct Video {
         delete decoder;
         delete frameTex[0];
         delete frameTex[1];
-        delete[] frameData;
+        for (int i = 0; i < FRAME_QUEUE; i++) {
+            delete[] frameData[i];
+        }
     }
 
+    bool decodeFrame() {
+        bool res = decoder->decodeVideo(frameData[queueTail % FRAME_QUEUE]);
+
+        OS_LOCK(frameLock);
+        if (res) {
+            queueTail++;
+        } else {
+            isDecoded = true;
+        }
+        return res;
+    }
+
+    float getAudioTime() {
+        OS_LOCK(Sound::lock);
+        if (sample && sample->decoder == decoder && sample->isPlaying) {
+            return sample->framesDecoded / audioFreq;
+        }
+        return -1.0f;
+    }
+
+#ifdef VIDEO_TEST
+    void benchmark() {
+        static const char *codecs[] = { "Escape", "STR", "Cinepak" };
+
+        int count = 0;
+        int t = Core::getTime();
+        while (decoder->decodeVideo(frameData[0])) {
+            count++;
+        }
+        t = max(1, Core::getTime() - t);
+
+        LOG("video: %s %dx%d %d frames in %d ms, %.1f fps\n", codecs[format], decoder->width, decoder->height, count, t, count * 1000.0f / t);
+    }
+#endif
+
     void update() {
         if (!isPlaying) return;
 
-        stepTimer += Core::deltaTime;
-        if (stepTimer < step)
-            return;
-        stepTimer -= step;
-        time += step;
     #ifdef VIDEO_TEST
-        int t = Core::getTime();
-        while (decoder->decodeVideo(frameData)) {}
-        LOG("time: %d\n", Core::getTime() - t);
+        benchmark();
         isPlaying = false;
-    #else
-        isPlaying = needUpdate = decoder->decodeVideo(frameData);
+        return;
     #endif
+
+        float audioTime = getAudioTime();
+        if (audioTime >= 0.0f) {
+            time = audioTime;
+        } else {
+            time += Core::deltaTime;
+        }
+
+        int  due = int(time / step) + 1; // frames that should be shown at the current time
+        bool decoded = false;
+
+        while (queueHead < due) {
+            if (!isThreaded && !decoded && queueHead == queueTail) { // decode in place, one frame per update max
+                decodeFrame();
+                decoded = true;
+            }
+
+            int  ready;
+            bool done;
+            {
+                OS_LOCK(frameLock);
+                ready = queueTail - queueHead;
+                done  = isDecoded;
+            }
+
+            if (!ready) {
+                if (done) {
+                    isPlaying = false;
+                }
+                break; // decoder is late, hold the current frame
+            }
+
+            if (needUpdate) {
+                freeFrames.post(); // drop the frame that never reached the GPU
+            }
+
+            frameIndex = queueHead++ % FRAME_QUEUE;
+            needUpdate = true;
+        }
+
+        stepTimer = clamp(time - (queueHead - 1) * step, 0.0f, step);
     }
 
     void render() { // update GPU texture
         if (!needUpdate) return;
-        frameTex[0]->update(frameData);
+        frameTex[0]->update(frameData[frameIndex]);
         swap(frameTex[0], frameTex[1]);
         needUpdate = false;
+        freeFrames.post();
     }
 };
 